@@ -4,9 +4,13 @@
 #include "stdafx.h"
 #include <time.h>
 #include <stdio.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #pragma warning(disable: 4996)
+#else
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "FLEX.h"
@@ -161,6 +165,78 @@ void *ConsumerProc(void *Param)
     return 0;
 }
 
+/* The same consumer draining the buffer in batches. Blocks that have
+ * arrived while the consumer was busy are taken with one get and one
+ * put, see FLEX_GetRdBlocks.
+ *
+ * Run it with "./Example blocks".
+ */
+void *BlocksConsumerProc(void *Param)
+{
+    /* Retrieve instance pointer */
+    FLEX_BUFFER *BufferPtr = (FLEX_BUFFER *)Param;
+
+    FILE *File = fopen(NAME_DST, "wb+");
+
+    if (!File)
+        return 0;
+
+    const size_t Block = 256; /* Read up to 4 blocks of 256 bytes each time */
+
+    size_t Transfer = 0;
+
+    while (Transfer < TOTAL_TRANSFER)
+    {
+        /* Wait at most 1000 ms for the first block, then take
+         * all whole blocks that have arrived, up to Count. */
+
+        size_t Count = 4;
+
+        FLEX_RANGE* RangePtr = FLEX_GetRdBlocks(BufferPtr, Block, &Count, 1000);
+
+        if (RangePtr)
+        {
+            /* Count blocks are successfully dequeued */
+
+            for (size_t i = 0; i < Count; i++)
+            {
+                size_t Size;
+                uint8_t *Data = FLEX_GetRangeDataAt(RangePtr, i * Block, &Size);
+
+                /* A block at the end of circular buffer
+                 * continues at the start of it. */
+
+                if (Size >= Block)
+                {
+                    fwrite(Data, 1, Block, File);
+                }
+                else
+                {
+                    size_t First = Size;
+
+                    fwrite(Data, 1, First, File);
+
+                    Data = FLEX_GetRangeDataAt(RangePtr, i * Block + First, &Size);
+
+                    fwrite(Data, 1, Block - First, File);
+                }
+            }
+
+            Transfer += Count * Block;
+
+            fflush(File);
+
+            /* Return all blocks back to instance with
+             * one put and make them ready to write again. */
+
+            FLEX_PutRdBuffer(BufferPtr, RangePtr);
+        }
+    }
+
+    fclose(File);
+    return 0;
+}
+
 bool VerifyData()
 {
     size_t i;
@@ -205,8 +281,687 @@ bool VerifyData()
     return Match;
 }
 
-int main(void)
+#ifndef _WIN32
+
+/* The benchmark relays data from one pipe to another through a Flex
+ * Buffer instance, either with a plain read/write loop or with the I/O
+ * engine. A source thread fills the first pipe, and a sink thread
+ * drains the second one.
+ *
+ * Run it with "./Example uring".
+ */
+
+#define BENCH_TOTAL     (256 * 1024 * 1024)
+#define BENCH_BLOCK     (64 * 1024)
+#define BENCH_BUFFER    (1024 * 1024)
+
+static int BenchIn[2];
+static int BenchOut[2];
+
+void *BenchSourceProc(void *Param)
+{
+    static uint8_t Block[BENCH_BLOCK];
+
+    (void)Param;
+
+    size_t Transfer = 0;
+
+    while (Transfer < BENCH_TOTAL)
+    {
+        ssize_t Ret = write(BenchIn[1], Block, sizeof(Block));
+
+        if (Ret <= 0)
+            break;
+
+        Transfer += (size_t)Ret;
+    }
+
+    close(BenchIn[1]);
+    return 0;
+}
+
+void *BenchSinkProc(void *Param)
+{
+    static uint8_t Block[BENCH_BLOCK];
+
+    size_t *Transfer = (size_t *)Param;
+
+    ssize_t Ret;
+
+    while ((Ret = read(BenchOut[0], Block, sizeof(Block))) > 0)
+    {
+        *Transfer += (size_t)Ret;
+    }
+
+    return 0;
+}
+
+/* The loop every user writes, one read() or write() for each part of the
+ * ranges. Pipes are blocking, and the source and the sink keep them going.
+ */
+void BenchPlain(FLEX_BUFFER *BufferPtr)
+{
+    bool End = false;
+
+    while (!End || FLEX_PeekRdLength(BufferPtr))
+    {
+        FLEX_RANGE *RangePtr = End ? NULL : FLEX_GetWrBuffer(BufferPtr, BENCH_BLOCK, true, 0);
+
+        if (RangePtr)
+        {
+            size_t First, Size;
+            uint8_t *Data = FLEX_GetRangeData(RangePtr, &First);
+
+            ssize_t Ret = read(BenchIn[0], Data, First);
+            size_t Transfer = (Ret > 0) ? (size_t)Ret : 0;
+
+            /* The second part is read once the first one is full */
+            Data = FLEX_GetExtraData(RangePtr, &Size);
+
+            if (Data && Transfer == First)
+            {
+                Ret = read(BenchIn[0], Data, Size);
+                Transfer += (Ret > 0) ? (size_t)Ret : 0;
+            }
+
+            if (Ret <= 0)
+                End = true;
+
+            FLEX_PutWrBufferEx(BufferPtr, RangePtr, Transfer);
+        }
+
+        RangePtr = FLEX_GetRdBuffer(BufferPtr, BENCH_BLOCK, true, 0);
+
+        if (RangePtr)
+        {
+            size_t First, Size;
+            uint8_t *Data = FLEX_GetRangeData(RangePtr, &First);
+
+            ssize_t Ret = write(BenchOut[1], Data, First);
+            size_t Transfer = (Ret > 0) ? (size_t)Ret : 0;
+
+            Data = FLEX_GetExtraData(RangePtr, &Size);
+
+            if (Data && Transfer == First)
+            {
+                Ret = write(BenchOut[1], Data, Size);
+                Transfer += (Ret > 0) ? (size_t)Ret : 0;
+            }
+
+            FLEX_PutRdBufferEx(BufferPtr, RangePtr, Transfer);
+        }
+    }
+}
+
+/* The same relay driven by the engine, one read and one write in flight */
+void BenchEngine(FLEX_BUFFER *BufferPtr)
+{
+    FLEX_ENGINE *EnginePtr = FLEX_CreateEngine(2);
+
+    if (!EnginePtr)
+        return;
+
+    /* Without io_uring the engine polls non-blocking descriptors */
+    if (!(FLEX_GetEngineFlags(EnginePtr) & FLEX_ENGINE_URING))
+    {
+        fcntl(BenchIn[0], F_SETFL, fcntl(BenchIn[0], F_GETFL) | O_NONBLOCK);
+        fcntl(BenchOut[1], F_SETFL, fcntl(BenchOut[1], F_GETFL) | O_NONBLOCK);
+    }
+
+    int Reader = FLEX_AddEngineStream(EnginePtr, BufferPtr, BenchIn[0], false, BENCH_BLOCK);
+    int Writer = FLEX_AddEngineStream(EnginePtr, BufferPtr, BenchOut[1], true, BENCH_BLOCK);
+
+    while (FLEX_GetEngineStream(EnginePtr, Reader, NULL) == FLEX_STREAM_ACTIVE || FLEX_PeekRdLength(BufferPtr))
+    {
+        if (FLEX_RunEngine(EnginePtr, 100) < 0)
+            break;
+
+        if (FLEX_GetEngineStream(EnginePtr, Reader, NULL) < 0 || FLEX_GetEngineStream(EnginePtr, Writer, NULL) < 0)
+            break;
+    }
+
+    FLEX_DeleteEngine(EnginePtr);
+}
+
+double BenchRun(bool Engine)
+{
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBuffer(BENCH_BUFFER, 4096);
+
+    if (!BufferPtr)
+        return 0;
+
+    if (pipe(BenchIn) || pipe(BenchOut))
+    {
+        FLEX_DeleteBuffer(BufferPtr);
+        return 0;
+    }
+
+    size_t Transfer = 0;
+
+    pthread_t TID_Source;
+    pthread_t TID_Sink;
+
+    uint64_t Start = FLEX_GetTime();
+
+    pthread_create(&TID_Source, NULL, BenchSourceProc, NULL);
+    pthread_create(&TID_Sink, NULL, BenchSinkProc, &Transfer);
+
+    if (Engine)
+        BenchEngine(BufferPtr);
+    else
+        BenchPlain(BufferPtr);
+
+    /* End of file for the sink */
+    close(BenchOut[1]);
+
+    void *Ret;
+
+    pthread_join(TID_Source, &Ret);
+    pthread_join(TID_Sink, &Ret);
+
+    uint64_t Time = FLEX_GetTime() - Start;
+
+    close(BenchIn[0]);
+    close(BenchOut[0]);
+
+    FLEX_DeleteBuffer(BufferPtr);
+
+    if (Transfer != BENCH_TOTAL || !Time)
+        return 0;
+
+    /* MB/s */
+    return (double)Transfer * 1000.0 / (double)Time;
+}
+
+int BenchMain(void)
+{
+    FLEX_ENGINE *EnginePtr = FLEX_CreateEngine(2);
+
+    uint32_t Flags = EnginePtr ? FLEX_GetEngineFlags(EnginePtr) : 0;
+
+    if (EnginePtr)
+        FLEX_DeleteEngine(EnginePtr);
+
+    printf("ENGINE ... %s%s\n", (Flags & FLEX_ENGINE_URING) ? "io_uring" : "readv/writev fallback",
+        (Flags & FLEX_ENGINE_FIXED) ? ", fixed buffers" : "");
+
+    printf("PLAIN  ... %.0f MB/s\n", BenchRun(false));
+    printf("ENGINE ... %.0f MB/s\n", BenchRun(true));
+
+    return 0;
+}
+
+#endif
+
+/* The copy benchmark moves data through a Flex Buffer instance in one
+ * thread, block by block, copying it in and out with memcpy on the ranges
+ * or with FLEX_WriteBytes and FLEX_ReadBytes.
+ *
+ * Run it with "./Example copy".
+ */
+
+#define COPY_TOTAL      (1024 * 1024 * 1024)
+#define COPY_BUFFER     (64 * 1024 * 1024)
+
+double CopyRun(FLEX_BUFFER *BufferPtr, uint8_t *Src, uint8_t *Dst, size_t Block, bool Bytes)
+{
+    uint64_t Start = FLEX_GetTime();
+
+    for (size_t Transfer = 0; Transfer < COPY_TOTAL; Transfer += Block)
+    {
+        if (Bytes)
+        {
+            FLEX_WriteBytes(BufferPtr, Src, Block, false, 0);
+            FLEX_ReadBytes(BufferPtr, Dst, Block, false, 0);
+            continue;
+        }
+
+        size_t Size;
+        size_t First;
+
+        FLEX_RANGE *Range = FLEX_GetWrBuffer(BufferPtr, Block, false, 0);
+
+        uint8_t *Data = FLEX_GetRangeData(Range, &First);
+        memcpy(Data, Src, First);
+
+        Data = FLEX_GetExtraData(Range, &Size);
+        if (Data)
+            memcpy(Data, Src + First, Size);
+
+        FLEX_PutWrBuffer(BufferPtr, Range);
+
+        Range = FLEX_GetRdBuffer(BufferPtr, Block, false, 0);
+
+        Data = FLEX_GetRangeData(Range, &First);
+        memcpy(Dst, Data, First);
+
+        Data = FLEX_GetExtraData(Range, &Size);
+        if (Data)
+            memcpy(Dst + First, Data, Size);
+
+        FLEX_PutRdBuffer(BufferPtr, Range);
+    }
+
+    uint64_t Time = FLEX_GetTime() - Start;
+
+    /* MB/s */
+    return Time ? (double)COPY_TOTAL * 1000.0 / (double)Time : 0;
+}
+
+int CopyMain(void)
+{
+    static const size_t Blocks[] = { 4096, 65536, 1024 * 1024, 16 * 1024 * 1024 };
+
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBuffer(COPY_BUFFER, 4096);
+
+    uint8_t *Src = (uint8_t *)malloc(Blocks[3]);
+    uint8_t *Dst = (uint8_t *)malloc(Blocks[3]);
+
+    if (!BufferPtr || !Src || !Dst)
+    {
+        FLEX_DeleteBuffer(BufferPtr);
+        free(Src);
+        free(Dst);
+        return -1;
+    }
+
+    memset(Src, 0x5A, Blocks[3]);
+    memset(Dst, 0, Blocks[3]);
+
+    for (size_t i = 0; i < sizeof(Blocks) / sizeof(Blocks[0]); i++)
+    {
+        /* Blocks that do not divide the buffer size make ranges wrap around */
+        size_t Block = Blocks[i] - 8;
+
+        double Plain = CopyRun(BufferPtr, Src, Dst, Block, false);
+        double Bytes = CopyRun(BufferPtr, Src, Dst, Block, true);
+
+        printf("BLOCK %8zu ... memcpy %.0f MB/s, FLEX_WriteBytes/ReadBytes %.0f MB/s\n", Block, Plain, Bytes);
+    }
+
+    FLEX_DeleteBuffer(BufferPtr);
+    free(Src);
+    free(Dst);
+
+    return 0;
+}
+
+/* The record check writes records longer than half of the buffer at
+ * every position, so that each one is preceded by padding, and reads
+ * them back.
+ *
+ * Run it with "./Example record".
+ */
+
+#define RECORD_BUFFER   4096
+#define RECORD_LONG     3000
+
+bool RecordCheck(FLEX_BUFFER *BufferPtr, size_t Length, uint8_t Seed)
+{
+    size_t i, Size;
+
+    FLEX_RANGE *Range = FLEX_GetWrRecord(BufferPtr, Length, 0);
+
+    /* The padding is put, and there is room after the reader skips it */
+    if (!Range)
+    {
+        if (FLEX_GetRdRecord(BufferPtr, 0))
+            return false;
+
+        Range = FLEX_GetWrRecord(BufferPtr, Length, 0);
+    }
+
+    if (!Range)
+        return false;
+
+    uint8_t *Data = FLEX_GetRangeData(Range, &Size);
+
+    for (i = 0; i < Size; i++)
+        Data[i] = (uint8_t)(Seed + i);
+
+    FLEX_PutWrBuffer(BufferPtr, Range);
+
+    Range = FLEX_GetRdRecord(BufferPtr, 0);
+
+    if (!Range)
+        return false;
+
+    Data = FLEX_GetRangeData(Range, &Size);
+
+    bool Match = (Size == Length);
+
+    for (i = 0; i < Size && Match; i++)
+        Match = (Data[i] == (uint8_t)(Seed + i));
+
+    FLEX_PutRdBuffer(BufferPtr, Range);
+
+    return Match;
+}
+
+int RecordMain(void)
+{
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBufferEx(RECORD_BUFFER, 0, FLEX_FLAG_RECORD);
+
+    if (!BufferPtr)
+    {
+        return -1;
+    }
+
+    bool Match = true;
+
+    /* Each short record moves the write position on by 16 bytes */
+    for (size_t Shift = 0; Shift < RECORD_BUFFER / 8 && Match; Shift++)
+    {
+        Match = RecordCheck(BufferPtr, RECORD_LONG, (uint8_t)Shift) && RecordCheck(BufferPtr, 1, 0);
+
+        /* A record of the whole buffer fits after the padding too */
+        if (Match && Shift % 64 == 0)
+            Match = RecordCheck(BufferPtr, RECORD_BUFFER - 8, (uint8_t)~Shift);
+    }
+
+    FLEX_DeleteBuffer(BufferPtr);
+
+    printf("RECORD ... %s\n", Match ? "OK" : "ERROR");
+
+    return Match ? 0 : -1;
+}
+
+/* The frame check feeds a length field larger than the buffer, which
+ * must be told apart from a timeout, then skips the bad header and gets
+ * the next frame.
+ *
+ * Run it with "./Example frame".
+ */
+
+#define FRAME_BUFFER    1024
+
+int FrameMain(void)
 {
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBuffer(FRAME_BUFFER, 0);
+
+    if (!BufferPtr)
+    {
+        return -1;
+    }
+
+    /* A 2-byte big-endian length field counts the payload only */
+    FLEX_SetFrameFormat(BufferPtr, 0, 2, true, 0);
+
+    /* Nothing written yet, this is a timeout */
+    bool Match = !FLEX_GetRdFrame(BufferPtr, 0) && errno == ETIMEDOUT;
+
+    const uint8_t Bad[2] = { 0xFF, 0xFF };
+    const uint8_t Good[6] = { 0x00, 0x04, 'F', 'L', 'E', 'X' };
+
+    Match = Match && FLEX_WriteBytes(BufferPtr, Bad, sizeof(Bad), false, 0) == sizeof(Bad);
+    Match = Match && FLEX_WriteBytes(BufferPtr, Good, sizeof(Good), false, 0) == sizeof(Good);
+
+    /* The bad header is reported, and stays until it is skipped */
+    Match = Match && !FLEX_GetRdFrame(BufferPtr, 0) && errno == EBADMSG;
+    Match = Match && !FLEX_GetRdFrame(BufferPtr, 0) && errno == EBADMSG;
+    Match = Match && FLEX_SkipRdData(BufferPtr, sizeof(Bad), false, 0) == sizeof(Bad);
+
+    FLEX_RANGE *Range = Match ? FLEX_GetRdFrame(BufferPtr, 0) : NULL;
+
+    if (Range)
+    {
+        size_t i, Size;
+
+        /* The frame may be divided in two parts */
+        for (i = 0; i < sizeof(Good) && Match; i++)
+        {
+            uint8_t *Data = FLEX_GetRangeDataAt(Range, i, &Size);
+
+            Match = Data && Data[0] == Good[i];
+        }
+
+        Match = Match && !FLEX_GetRangeDataAt(Range, sizeof(Good), &Size);
+
+        FLEX_PutRdBuffer(BufferPtr, Range);
+    }
+    else
+    {
+        Match = false;
+    }
+
+    FLEX_DeleteBuffer(BufferPtr);
+
+    printf("FRAME ... %s\n", Match ? "OK" : "ERROR");
+
+    return Match ? 0 : -1;
+}
+
+/* The resize check moves a byte sequence from a producer to a consumer
+ * that spin before they sleep, while the main thread resizes the buffer
+ * over and over. The consumer checks every byte it reads.
+ *
+ * Run it with "./Example resize".
+ */
+
+#define RESIZE_TOTAL    (16 * 1024 * 1024)
+
+static volatile bool ResizeDone = false;
+static volatile bool ResizeMatch = true;
+
+void *ResizeProducerProc(void *Param)
+{
+    FLEX_BUFFER *BufferPtr = (FLEX_BUFFER *)Param;
+
+    uint8_t Block[1500];
+    uint8_t Seq = 0;
+
+    size_t Transfer = 0;
+
+    while (Transfer < RESIZE_TOTAL && ResizeMatch)
+    {
+        size_t i, Length = (Transfer * 7) % sizeof(Block) + 1;
+
+        for (i = 0; i < Length; i++)
+            Block[i] = (uint8_t)(Seq + i);
+
+        /* A partial write leaves the rest of the sequence for the next one */
+        size_t Size = FLEX_WriteBytes(BufferPtr, Block, Length, true, 1000);
+
+        Seq = (uint8_t)(Seq + Size);
+        Transfer += Size;
+    }
+
+    return 0;
+}
+
+void *ResizeConsumerProc(void *Param)
+{
+    FLEX_BUFFER *BufferPtr = (FLEX_BUFFER *)Param;
+
+    uint8_t Block[1000];
+    uint8_t Seq = 0;
+
+    size_t Transfer = 0;
+
+    while (Transfer < RESIZE_TOTAL && ResizeMatch)
+    {
+        size_t i, Size = FLEX_ReadBytes(BufferPtr, Block, sizeof(Block), true, 1000);
+
+        for (i = 0; i < Size; i++)
+        {
+            if (Block[i] != (uint8_t)(Seq + i))
+                ResizeMatch = false;
+        }
+
+        Seq = (uint8_t)(Seq + Size);
+        Transfer += Size;
+    }
+
+    ResizeDone = true;
+    return 0;
+}
+
+int ResizeMain(void)
+{
+    static const size_t Sizes[] = { 4096, 1024, 65536, 2048, 16384 };
+
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBuffer(4096, 16);
+
+    if (!BufferPtr)
+    {
+        return -1;
+    }
+
+    /* Spin and yield first, so that the sides wait without the mutex */
+    FLEX_SetWaitPolicy(BufferPtr, 1000, 10);
+
+    size_t Resized = 0;
+    size_t Count = 0;
+
+#ifdef _WIN32
+    HANDLE hProducer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ResizeProducerProc, BufferPtr, 0, NULL);
+    HANDLE hConsumer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ResizeConsumerProc, BufferPtr, 0, NULL);
+#else
+    pthread_t TID_Producer;
+    pthread_t TID_Consumer;
+
+    pthread_create(&TID_Producer, NULL, ResizeProducerProc, BufferPtr);
+    pthread_create(&TID_Consumer, NULL, ResizeConsumerProc, BufferPtr);
+#endif
+
+    /* Resizes are refused while the data does not fit the new size */
+    while (!ResizeDone)
+    {
+        if (FLEX_ResizeBuffer(BufferPtr, Sizes[Count++ % (sizeof(Sizes) / sizeof(Sizes[0]))]))
+            Resized++;
+    }
+
+#ifdef _WIN32
+    WaitForSingleObject(hProducer, INFINITE);
+    WaitForSingleObject(hConsumer, INFINITE);
+#else
+    void *Ret;
+
+    pthread_join(TID_Producer, &Ret);
+    pthread_join(TID_Consumer, &Ret);
+#endif
+
+    FLEX_DeleteBuffer(BufferPtr);
+
+    bool Match = ResizeMatch && Resized > 0;
+
+    printf("RESIZE ... %s (%zu of %zu resized)\n", Match ? "OK" : "ERROR", Resized, Count);
+
+    return Match ? 0 : -1;
+}
+
+/* The lock-free check runs the producer and the consumer above on a
+ * lock-free instance, while a third thread keeps peeking the lengths
+ * the way a monitoring thread would.
+ *
+ * Run it with "./Example lockfree".
+ */
+
+#define LOCKFREE_BUFFER 1024
+
+static volatile bool MonitorDone = false;
+static volatile size_t MonitorWrong = 0;
+
+void *MonitorProc(void *Param)
+{
+    FLEX_BUFFER *BufferPtr = (FLEX_BUFFER *)Param;
+
+    while (!MonitorDone)
+    {
+        /* Neither length may exceed the buffer size */
+        if (FLEX_PeekWrLength(BufferPtr) > LOCKFREE_BUFFER || FLEX_PeekRdLength(BufferPtr) > LOCKFREE_BUFFER)
+            MonitorWrong++;
+    }
+
+    return 0;
+}
+
+int LockFreeMain(void)
+{
+    FLEX_BUFFER *BufferPtr = FLEX_CreateBufferEx(LOCKFREE_BUFFER, 16, FLEX_FLAG_LOCKFREE);
+
+    if (!BufferPtr)
+    {
+        return -1;
+    }
+
+#ifdef _WIN32
+    HANDLE hProducer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ProducerProc, BufferPtr, 0, NULL);
+    HANDLE hConsumer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ConsumerProc, BufferPtr, 0, NULL);
+    HANDLE hMonitor = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)MonitorProc, BufferPtr, 0, NULL);
+
+    WaitForSingleObject(hProducer, INFINITE);
+    WaitForSingleObject(hConsumer, INFINITE);
+
+    MonitorDone = true;
+
+    WaitForSingleObject(hMonitor, INFINITE);
+#else
+    pthread_t TID_Producer;
+    pthread_t TID_Consumer;
+    pthread_t TID_Monitor;
+
+    pthread_create(&TID_Producer, NULL, ProducerProc, BufferPtr);
+    pthread_create(&TID_Consumer, NULL, ConsumerProc, BufferPtr);
+    pthread_create(&TID_Monitor, NULL, MonitorProc, BufferPtr);
+
+    void *Ret;
+
+    pthread_join(TID_Producer, &Ret);
+    pthread_join(TID_Consumer, &Ret);
+
+    MonitorDone = true;
+
+    pthread_join(TID_Monitor, &Ret);
+#endif
+
+    FLEX_DeleteBuffer(BufferPtr);
+
+    bool Match = VerifyData() && MonitorWrong == 0;
+
+    printf("LOCKFREE ... %s\n", Match ? "OK" : "ERROR");
+
+    return Match ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    /* Benchmarks are run on request only */
+    if (argc > 1 && strcmp(argv[1], "uring") == 0)
+    {
+#ifdef _WIN32
+        printf("io_uring is not supported on Windows\n");
+        return -1;
+#else
+        return BenchMain();
+#endif
+    }
+
+    if (argc > 1 && strcmp(argv[1], "copy") == 0)
+    {
+        return CopyMain();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "record") == 0)
+    {
+        return RecordMain();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "frame") == 0)
+    {
+        return FrameMain();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "resize") == 0)
+    {
+        return ResizeMain();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "lockfree") == 0)
+    {
+        return LockFreeMain();
+    }
+
     /* In this exmaple a Flex Buffer instance is created 
      * with a given buffer size and alignment. 
      *
@@ -229,10 +984,17 @@ int main(void)
      * Pass the instance pointer in as threads argument.
      */
 
+    void *(*Consumer)(void *) = ConsumerProc;
+
+    if (argc > 1 && strcmp(argv[1], "blocks") == 0)
+    {
+        Consumer = BlocksConsumerProc;
+    }
+
 #ifdef _WIN32
 
     HANDLE hProducer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ProducerProc, BufferPtr, 0, NULL);
-    HANDLE hConsumer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)ConsumerProc, BufferPtr, 0, NULL);
+    HANDLE hConsumer = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)Consumer, BufferPtr, 0, NULL);
 
     WaitForSingleObject(hProducer, INFINITE);
     WaitForSingleObject(hConsumer, INFINITE);
@@ -242,7 +1004,7 @@ int main(void)
     pthread_t TID_Consumer;
 
     pthread_create(&TID_Producer, NULL, ProducerProc, BufferPtr);
-    pthread_create(&TID_Consumer, NULL, ConsumerProc, BufferPtr);
+    pthread_create(&TID_Consumer, NULL, Consumer, BufferPtr);
 
     void *Ret;
 
@@ -3,6 +3,8 @@
 #include "FLEX.h"
 #include "FLEX_OS.h"
 
+#include <errno.h>
+
 typedef struct FLEX_RANGE
 {
     uint8_t    * Data;
@@ -11,596 +13,4232 @@ typedef struct FLEX_RANGE
 
 } FLEX_RANGE;
 
+/* Each side owns one cache line set, so the producer and the consumer
+ * do not write to the same line. Index is read by the peer, everything
+ * else is private to the owner (or to the mutex holder in locked mode).
+ */
+typedef struct FLEX_ALIGNED(FLEX_CACHE_LINE) FLEX_CURSOR
+{
+    volatile size_t Index;          /* Published index, only written by the owner */
+    volatile size_t Waiting;        /* Owner is sleeping, a count under the mutex in locked mode */
+    volatile size_t Armed;          /* Owner polled in vain, raise the event fd on progress */
+    size_t          Cached;         /* Local copy of the peer index */
+
+    volatile size_t Signaled;       /* Wake-ups sent to the peer */
+    volatile size_t Elided;         /* Wake-ups skipped because the peer was not sleeping */
+
+    FLEX_RANGE      Range[2];       /* The buffer may be divided into two parts */
+    size_t          Record;         /* Record mode, the whole record read with alignment (RD) */
+
+    uint8_t         Pattern[FLEX_MAX_PATTERN];  /* Pattern searched by FLEX_GetRdPattern */
+    size_t          PatternLength;
+    size_t          Scanned;        /* Bytes from Index known not to start a match */
+
+    size_t          Held;           /* Bytes from Index held by transfers, see FLEX_CompleteRd */
+    bool            Transferring;   /* A transfer or completion is in progress */
+
+    /* Checksum of the data passed by the side, read by any thread while
+     * CrcSeq is even and unchanged
+     */
+    volatile size_t CrcSeq;
+    volatile size_t Crc;            /* CRC32C, see FLEX_FLAG_CRC32C */
+    volatile uint64_t CrcBytes;
+
+    bool            Dequeued;
+
+} FLEX_CURSOR;
+
+/* Header in front of each record in record mode. A padding header takes
+ * the rest of the buffer when a record does not fit before the end, and
+ * its Length is the number of bytes skipped.
+ */
+typedef struct FLEX_RECORD
+{
+    uint32_t Length;
+    uint32_t Padding;
+
+} FLEX_RECORD;
+
+#define FLEX_RECORD_ALIGN 8
+
+/* Buffer taken by a record of Length bytes, header included */
+#define FLEX_RECORD_LENGTH(Length) \
+    (sizeof(FLEX_RECORD) + (((Length) + FLEX_RECORD_ALIGN - 1) & ~(size_t)(FLEX_RECORD_ALIGN - 1)))
+
+/* Reservation slot of the multi-reserve mode. Slot (Seq % FLEX_SLOTS)
+ * may be taken by reservation Seq only when its Turn equals Seq, which
+ * is set once reservation (Seq - FLEX_SLOTS) has been published.
+ */
+typedef struct FLEX_ALIGNED(FLEX_CACHE_LINE) FLEX_SLOT
+{
+    volatile size_t Turn;
+    volatile size_t State;          /* FLEX_SLOT_XXX */
+    size_t          Start;          /* Reserved indices [Start, End) */
+    size_t          End;
+
+    FLEX_RANGE      Range[2];
+
+} FLEX_SLOT;
+
+#define FLEX_SLOTS          FLEX_MAX_RESERVATIONS   /* Power of 2, divides FLEX_SEQ_MASK + 1 */
+
+#define FLEX_SLOT_FREE      0
+#define FLEX_SLOT_RESERVED  1
+#define FLEX_SLOT_COMMITTED 2
+
+/* The reservation word packs a sequence above the index, so that a CAS
+ * does not succeed on an index which has wrapped around in the meantime.
+ */
+#define FLEX_INDEX_BITS     40
+#define FLEX_INDEX_MASK     ((1ULL << FLEX_INDEX_BITS) - 1)
+#define FLEX_SEQ_MASK       0xFFFFFFUL
+
+/* Reader of the broadcast mode, only used by the thread it is attached to */
+typedef struct FLEX_ALIGNED(FLEX_CACHE_LINE) FLEX_READER
+{
+    FLEX_CURSOR     Cursor;
+    FLEX_EVENT      Event;
+    volatile size_t State;          /* FLEX_READER_XXX */
+    bool            Lossy;          /* May be evicted when it holds back the producer */
+
+} FLEX_READER;
+
+#define FLEX_READER_FREE     0
+#define FLEX_READER_CLAIMED  1
+#define FLEX_READER_ATTACHED 2
+#define FLEX_READER_EVICTED  3
+
+/* Header page of a file-backed buffer. Indices are stored whenever they
+ * are published, so that the file holds the data put and not yet read.
+ */
+typedef struct FLEX_HEADER
+{
+    uint64_t        Magic;          /* FLEX_HEADER_MAGIC once initialized */
+    uint64_t        Size;
+    uint32_t        Flags;          /* Creation flags that change the layout */
+    uint32_t        Reserved;
+
+    FLEX_ALIGNED(FLEX_CACHE_LINE)
+    volatile uint64_t Index[2];     /* [0] - WR / [1] - RD */
+
+} FLEX_HEADER;
+
+#define FLEX_HEADER_MAGIC   0x3152454646554258ULL   /* "XBUFFER1" */
+#define FLEX_HEADER_FLAGS   FLEX_FLAG_RECORD
+
+/* Control block at the start of shared memory, followed by the data at
+ * FLEX_SharedOffset. Each cursor is only written by the process of its
+ * side, and the ranges in it point into the mapping of that process.
+ */
+typedef struct FLEX_SHARED
+{
+    volatile uint64_t Magic;        /* FLEX_SHARED_MAGIC once initialized */
+    uint64_t        Size;
+    uint32_t        Flags;
+    uint32_t        Reserved;
+
+    FLEX_CURSOR     Cursor[2];
+
+} FLEX_SHARED;
+
+#define FLEX_SHARED_MAGIC   0x3152414853584C46ULL   /* "FLXSHAR1" */
+
+/* Stream of an engine, with at most one operation in flight */
+typedef struct FLEX_STREAM
+{
+    FLEX_BUFFER *   FlexBuffer;     /* NULL if the stream is free */
+    int             Fd;
+    int             Side;           /* 0 - read Fd into the buffer / 1 - write data to Fd */
+    size_t          Length;         /* Maximum bytes of one operation */
+    int             Fixed;          /* Fixed buffer slot, -1 if not registered */
+    FLEX_RANGE *    Range;          /* Ranges of the operation in flight, NULL if none */
+    bool            Removing;       /* Freed once the operation in flight completes */
+    int             Status;         /* FLEX_STREAM_XXX or a negative error code */
+    uint64_t        Bytes;
+
+} FLEX_STREAM;
+
+typedef struct FLEX_ENGINE
+{
+    FLEX_URING      Uring;          /* Fd is -1 if io_uring is not used */
+    uint32_t        Depth;          /* Maximum operations in flight */
+    uint32_t        InFlight;
+
+    FLEX_STREAM     Streams[FLEX_MAX_STREAMS];
+
+} FLEX_ENGINE;
+
+/* User data of cancellations, streams are numbered from 1 */
+#define FLEX_ENGINE_CANCEL 0
+
+/* Transfer of data to read which the kernel still refers to. The held
+ * data is put back in transfer order, as transfers complete.
+ */
+typedef struct FLEX_TRANSFER
+{
+    int             Fd;
+    uint32_t        Id;             /* Zero-copy send number of the socket */
+    size_t          Length;
+    bool            ZeroCopy;       /* Otherwise spliced into a pipe */
+    bool            Done;
+
+} FLEX_TRANSFER;
+
+/* Page options of the data, cleared from the flags unless they took effect */
+#define FLEX_FLAG_PAGES (FLEX_FLAG_HUGE_PAGES | FLEX_FLAG_LOCK_MEMORY | FLEX_FLAG_PREFAULT | FLEX_FLAG_NUMA_MASK)
+
+/* Readers are Side 2 and above in internal calls */
+#define FLEX_READER_SIDE(Reader) ((Reader) + 2)
+
 typedef struct FLEX_BUFFER
 {
     uint8_t *       Data;
     size_t          Size;
-    size_t          Position;       /* Index of free buffer */
-    size_t          Length;         /* Free buffer length, 0 if no buffer available */
     size_t          Alignment;
+    uint32_t        Flags;
+
+    uint32_t        SpinCount;      /* Wait policy, see FLEX_SetWaitPolicy */
+    uint32_t        YieldCount;
+
+    size_t          FrameOffset;    /* Frame format, see FLEX_SetFrameFormat */
+    size_t          FrameWidth;     /* 0 if not set */
+    bool            FrameBigEndian;
+    int             FrameAdjust;
 
     FLEX_MUTEX      Mutex;
     FLEX_EVENT      Event[2];		/* [0] - WR / [1] - RD */
 
-    FLEX_RANGE      Range[2][2];    /* The buffer may be divided into two parts */
-    bool            Dequeued[2];
+    /* Both indices run in [0, 2 * Size) so that a full buffer can be told
+     * apart from an empty one. Cursor[0] is the producer and its index is
+     * the index of free buffer. Cursor[1] is the consumer and its index is
+     * the index of data buffer. Cursor points to Local, or to the cursors
+     * in shared memory.
+     */
+    FLEX_CURSOR     Local[2];
+    FLEX_CURSOR *   Cursor;
+
+    /* Multi-reserve state, shared by all producers */
+    FLEX_ALIGNED(FLEX_CACHE_LINE)
+    volatile uint64_t Reserve;      /* Sequence and index of the next reservation */
+    volatile size_t Publishing;     /* A producer is publishing committed slots */
+    volatile size_t Published;      /* Sequence of the next slot to publish */
+    size_t          Depth;          /* Maximum outstanding reservations, see FLEX_SetReserveDepth */
+
+    FLEX_SLOT *     Slots;          /* NULL if not in multi-reserve mode */
+
+    /* Broadcast state. Cursor[1] is the slowest attached reader, moved by
+     * one thread at a time, and is what the producer sees as read index.
+     */
+    volatile size_t Retiring;       /* A thread is moving Cursor[1] */
+
+    FLEX_READER *   Readers;        /* NULL if not in broadcast mode */
+
+    FLEX_HEADER *   Header;         /* NULL if not backed by a file */
+    FLEX_SHARED *   Shared;         /* NULL if not in shared memory */
+    size_t          MapSize;        /* Header page or control block, and data */
+    int             SharedFd;
+    char *          SharedName;     /* Removed on delete, only set by the creator */
+
+    size_t          PagesSize;      /* Data from FLEX_Pages_Malloc, 0 if not */
+    bool            HugeTlb;        /* Pages are from the hugetlbfs pool */
+
+    /* Elastic state, see FLEX_SetElasticPolicy */
+    size_t          ElasticThreshold;   /* Consumed pages are released at or below this much data */
+    uint32_t        ElasticIdle;        /* Milliseconds without activity before FLEX_TrimBuffer */
+    size_t          TrimIndex[2];       /* Indices when FLEX_TrimBuffer last saw activity */
+    uint64_t        TrimTime;
+    bool            Trimmed;            /* Free space released since the last activity */
+
+    /* Transfers waiting for completion, oldest first */
+    FLEX_TRANSFER   Transfers[FLEX_MAX_TRANSFERS];
+    size_t          TransferHead;
+    size_t          TransferCount;
+
+    int             ZeroCopyFd;     /* Socket of zero-copy sends, -1 if none */
+    uint32_t        ZeroCopyId;     /* Number of the next zero-copy send */
+
+    /* Data before the last resize, kept while a range got before is held */
+    uint8_t *       OldData;        /* NULL if freed */
+    size_t          OldSize;
+    size_t          OldPagesSize;
+    bool            Stale[2];       /* The range of a side is in OldData */
+
+    size_t          Engaged;        /* Engine streams of the instance */
 
 } FLEX_BUFFER;
 
-FLEX_BUFFER *FLEX_CreateBuffer(size_t Size, size_t Alignment)
+static inline size_t FLEX_Distance(FLEX_BUFFER *FlexBuffer, size_t From, size_t To)
 {
-    size_t i;
+    return (To >= From) ? To - From : To + 2 * FlexBuffer->Size - From;
+}
 
-    if (!Size)
-    {
-        return NULL;
-    }
+static inline size_t FLEX_Forward(FLEX_BUFFER *FlexBuffer, size_t Index, size_t Length)
+{
+    Index += Length;
 
-    FLEX_BUFFER *FlexBuffer = (FLEX_BUFFER *)calloc(1, sizeof(FLEX_BUFFER));
+    /* Wrap-around */
+    if (Index >= 2 * FlexBuffer->Size)
+        Index -= 2 * FlexBuffer->Size;
 
-    if (!FlexBuffer)
-    {
-        return NULL;
-    }
+    return Index;
+}
 
-    int Ret = FLEX_CreateMutex(&FlexBuffer->Mutex);
+/* Total length of ranges, both parts included */
+static inline size_t FLEX_RangeLength(FLEX_RANGE *Range)
+{
+    return Range->Next ? Range->Size + Range->Next->Size : Range->Size;
+}
 
-    if (Ret)
+/* Free length for the next reservation, 0 if its slot is still in use */
+static inline size_t FLEX_ReserveLength(FLEX_BUFFER *FlexBuffer, uint64_t Reserve)
+{
+    size_t Seq = (size_t)(Reserve >> FLEX_INDEX_BITS);
+
+    if (FLEX_Atomic_Load(&FlexBuffer->Slots[Seq % FLEX_SLOTS].Turn) != Seq)
     {
-        FLEX_DeleteBuffer(FlexBuffer);
-        return NULL;
+        return 0;
     }
 
-    for (i = 0; i < 2; i++)
+    if (((Seq - FLEX_Atomic_Load(&FlexBuffer->Published)) & FLEX_SEQ_MASK) >= FlexBuffer->Depth)
     {
-        Ret = FLEX_CreateEvent(&FlexBuffer->Event[i]);
-        if (Ret)
-        {
-            FLEX_DeleteBuffer(FlexBuffer);
-            return NULL;
-        }
+        return 0;
     }
-    
-    FlexBuffer->Length = Size;
-    FlexBuffer->Size = Size;
-    FlexBuffer->Alignment = Alignment;
 
-    if (Alignment)
+    /* Producers do not share a cached index, which would not be monotonic */
+    size_t RdIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+
+    return FlexBuffer->Size - FLEX_Distance(FlexBuffer, RdIndex, (size_t)(Reserve & FLEX_INDEX_MASK));
+}
+
+static void FLEX_Retire(FLEX_BUFFER *FlexBuffer, int Side, size_t Length);
+
+/* The cached peer index is only refreshed when it says that less than
+ * Length bytes are available, which keeps the peer cache line shared.
+ */
+static inline size_t FLEX_WrLength(FLEX_BUFFER *FlexBuffer, size_t Length)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[0];
+
+    if (FlexBuffer->Slots)
     {
-        FlexBuffer->Data = (uint8_t *)FLEX_Aligned_Malloc(Size, Alignment);
+        return FLEX_ReserveLength(FlexBuffer, FLEX_Atomic_Load64(&FlexBuffer->Reserve));
     }
-    else
-        FlexBuffer->Data = (uint8_t *)malloc(Size);
 
-    if (!FlexBuffer->Data)
+    size_t Actual = FlexBuffer->Size - FLEX_Distance(FlexBuffer, Cursor->Cached, Cursor->Index);
+
+    if (Actual < Length)
     {
-        FLEX_DeleteBuffer(FlexBuffer);
-        return NULL;
+        /* Readers only move the read index when it is their turn */
+        if (FlexBuffer->Readers)
+            FLEX_Retire(FlexBuffer, 0, Length);
+
+        Cursor->Cached = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+
+        Actual = FlexBuffer->Size - FLEX_Distance(FlexBuffer, Cursor->Cached, Cursor->Index);
     }
 
-    return FlexBuffer;
+    return Actual;
 }
 
-void FLEX_DeleteBuffer(FLEX_BUFFER *FlexBuffer)
+static inline size_t FLEX_RdLength(FLEX_BUFFER *FlexBuffer, FLEX_CURSOR *Cursor, size_t Length)
 {
-    size_t i;
+    size_t Actual = FLEX_Distance(FlexBuffer, Cursor->Index, Cursor->Cached);
 
-    if (!FlexBuffer)
+    if (Actual < Length)
     {
-        return;
+        Cursor->Cached = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
+
+        Actual = FLEX_Distance(FlexBuffer, Cursor->Index, Cursor->Cached);
     }
 
-    FLEX_DeleteMutex(&FlexBuffer->Mutex);
+    return Actual;
+}
 
-    for (i = 0; i < 2; i++)
+static inline size_t FLEX_Length(FLEX_BUFFER *FlexBuffer, int Side, size_t Length)
+{
+    if (Side < 2)
     {
-        FLEX_DeleteEvent(&FlexBuffer->Event[i]);
+        return Side ? FLEX_RdLength(FlexBuffer, &FlexBuffer->Cursor[1], Length) : FLEX_WrLength(FlexBuffer, Length);
     }
 
-    if (FlexBuffer->Data)
+    FLEX_READER *Reader = &FlexBuffer->Readers[Side - 2];
+
+    /* An evicted reader stops waiting at once, the caller checks the state */
+    if (FLEX_Atomic_Load(&Reader->State) != FLEX_READER_ATTACHED)
     {
-        if (FlexBuffer->Alignment)
-        {
-            FLEX_Aligned_Free(FlexBuffer->Data);
-        }
-        else
-            free(FlexBuffer->Data);
+        return SIZE_MAX;
     }
 
-    free(FlexBuffer);
+    return FLEX_RdLength(FlexBuffer, &Reader->Cursor, Length);
 }
 
-void FLEX_RestoreBuffer(FLEX_BUFFER *FlexBuffer)
+static inline FLEX_CURSOR *FLEX_GetCursor(FLEX_BUFFER *FlexBuffer, int Side)
 {
-    size_t i, j;
+    return (Side < 2) ? &FlexBuffer->Cursor[Side] : &FlexBuffer->Readers[Side - 2].Cursor;
+}
 
-    if (!FlexBuffer)
+static inline FLEX_EVENT *FLEX_GetEvent(FLEX_BUFFER *FlexBuffer, int Side)
+{
+    return (Side < 2) ? &FlexBuffer->Event[Side] : &FlexBuffer->Readers[Side - 2].Event;
+}
+
+static inline bool FLEX_Lock(FLEX_BUFFER *FlexBuffer)
+{
+    if (FlexBuffer->Flags & FLEX_FLAG_LOCKFREE)
     {
-        return;
+        return true;
     }
 
-    FlexBuffer->Position = 0;
-    FlexBuffer->Length = FlexBuffer->Size;
+#ifdef _WIN32
+    return FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE) == 0;
+#else
+    return FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL) == 0;
+#endif
+}
 
-    for (i = 0; i < 2; i++)
+static inline void FLEX_Unlock(FLEX_BUFFER *FlexBuffer)
+{
+    if (FlexBuffer->Flags & FLEX_FLAG_LOCKFREE)
     {
-        for (j = 0; j < 2; j++)
-        {
-            memset(&FlexBuffer->Range[i][j], 0, sizeof(FLEX_RANGE));
-        }
+        return;
     }
 
-    FlexBuffer->Dequeued[0] = false;
-    FlexBuffer->Dequeued[1] = false;
+    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
 }
 
-FLEX_RANGE *FLEX_GetWrBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds)
+/* Turn a timeout into a deadline for waits which may be repeated, NULL
+ * if Milliseconds is 0, so that the wait is a poll.
+ */
+static inline const uint64_t *FLEX_Deadline(uint32_t Milliseconds, uint64_t *Time)
 {
-    if (!FlexBuffer || !Length)
+    if (Milliseconds == 0)
     {
         return NULL;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    if (Milliseconds == FLEX_INFINITE)
+    {
+        *Time = FLEX_DEADLINE_INFINITE;
+    }
+    else
+        *Time = FLEX_Clock_Now() + Milliseconds * 1000000ULL;
 
-    if (Ret)
-        return NULL;
+    return Time;
+}
 
-    if (FlexBuffer->Dequeued[0])
+/* Remaining milliseconds until Deadline, for waits taking a relative timeout */
+static inline uint32_t FLEX_Remaining(uint64_t Deadline)
+{
+    if (Deadline == FLEX_DEADLINE_INFINITE)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
-        return NULL;
+        return FLEX_INFINITE;
     }
-    
-#ifdef _WIN32
-    FILETIME FileTime;
-
-    GetSystemTimeAsFileTime(&FileTime);
-#else
-    struct timespec Ts;
 
-    Ret = clock_gettime(CLOCK_REALTIME, &Ts);
+    uint64_t Now = FLEX_Clock_Now();
 
-    if (Ret)
+    if (Now >= Deadline)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
-        return NULL;
+        return 0; /* Time in the past */
     }
-#endif
 
+    /* Round up, and prevent from infinite wait if (Remaining == INFINITE) */
+    uint64_t Remaining = (Deadline - Now + 999999ULL) / 1000000ULL;
+
+    return (uint32_t)(Remaining < FLEX_INFINITE - 1 ? Remaining : FLEX_INFINITE - 1);
+}
+
+/* Park Side in lock-free mode until woken up or Deadline. The waiting
+ * flag is set by the caller, and the waker clears it before waking.
+ *
+ * Returns 0 if woken up (or spuriously), otherwise timeout.
+ */
+static inline int FLEX_Park(FLEX_BUFFER *FlexBuffer, int Side, uint64_t Deadline)
+{
 #ifdef _WIN32
-    uint64_t Time = (uint64_t)FileTime.dwLowDateTime + (((uint64_t)FileTime.dwHighDateTime) << 32);
+    uint32_t Timeout = FLEX_Remaining(Deadline);
+
+    if (Timeout == 0)
+    {
+        return WAIT_TIMEOUT;
+    }
 
-    /* FILETIME has a precision of 100-nano seconds */
-    Time /= 10000ULL;
+    /* Event state on Windows is preserved even if no wait is
+     * on going, so a wake-up between the flag and the wait is
+     * not lost.
+     */
+    int Result = FLEX_Event_Wait(FLEX_GetEvent(FlexBuffer, Side), Timeout);
 
-    if (Milliseconds != FLEX_INFINITE)
+    /* The event wakes one thread only. Pass it on to the other
+     * producers, as the futex wakes all of them on Linux.
+     */
+    if (Result == 0 && Side == 0 && FlexBuffer->Slots)
     {
-        Time += Milliseconds; /* Wait will be terminated at Time */
+        FLEX_Event_Signal(FLEX_GetEvent(FlexBuffer, Side));
     }
+
+    return Result;
 #else
-    if (Milliseconds != FLEX_INFINITE)
+    if (Deadline != FLEX_DEADLINE_INFINITE && FLEX_Clock_Now() >= Deadline)
     {
-        uint64_t Nano = Ts.tv_nsec + Milliseconds * 1000000ULL;
-
-        Ts.tv_sec += Nano / 1000000000ULL;
-        Ts.tv_nsec = Nano % 1000000000ULL;
+        return ETIMEDOUT;
     }
-#endif
 
-    FLEX_RANGE *Range = NULL;
+    /* The futex returns at once if the waker has already cleared the flag */
+    return FLEX_Futex_Wait(&FLEX_GetCursor(FlexBuffer, Side)->Waiting, 1, Deadline, FlexBuffer->Shared != NULL);
+#endif
+}
 
-    int Result = 0;
+/* Wait until Side has at least Length bytes or timeout, and return the
+ * available length. In locked mode the mutex is held by the caller.
+ *
+ * The wait spins, then yields, then sleeps, as configured by the wait
+ * policy. The deadline is Deadline if not NULL, otherwise Milliseconds
+ * from now, computed only when the wait actually has to sleep.
+ */
+static size_t FLEX_Wait(FLEX_BUFFER *FlexBuffer, int Side, size_t Length, uint32_t Milliseconds, const uint64_t *Deadline)
+{
+    size_t Actual = FLEX_Length(FlexBuffer, Side, Length);
 
-    while (FlexBuffer->Length < Length && Result == 0)
+    if (Actual >= Length)
     {
-#ifdef _WIN32
-        uint32_t Timeout = Milliseconds;
+        return Actual;
+    }
 
-        if (Milliseconds != FLEX_INFINITE)
+    if (!Deadline && Milliseconds == 0)
+    {
+        if (FlexBuffer->Flags & FLEX_FLAG_EVENTFD)
         {
-            GetSystemTimeAsFileTime(&FileTime);
+            /* Pairs with the fence in FLEX_Wake, as the waiting flag does */
+            FLEX_Atomic_Store(&FLEX_GetCursor(FlexBuffer, Side)->Armed, 1);
+            FLEX_Atomic_Fence();
+
+            Actual = FLEX_Length(FlexBuffer, Side, Length);
+        }
+
+        return Actual;
+    }
+
+    bool LockFree = (FlexBuffer->Flags & FLEX_FLAG_LOCKFREE) != 0;
+
+    uint32_t i, Count = FlexBuffer->SpinCount + FlexBuffer->YieldCount;
+
+    if (Count)
+    {
+        /* Indices are atomic, so spinning does not need the mutex. In
+         * locked mode a resize rewrites the size and the cached indices,
+         * so the spin only watches the peer index and the length is
+         * computed again with the mutex held. Locked mode has no slots
+         * or readers, the peer is the other cursor.
+         */
+        volatile size_t *Peer = &FlexBuffer->Cursor[!Side].Index;
 
-            uint64_t Now = (uint64_t)FileTime.dwLowDateTime + (((uint64_t)FileTime.dwHighDateTime) << 32);
+        size_t Seen = FLEX_Atomic_Load(Peer);
 
-            /* FILETIME has a precision of 100-nano seconds */
-            Now /= 10000ULL;
+        if (!LockFree)
+            FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
 
-            if (Now < Time)
+        for (i = 0; i < Count && Actual < Length; i++)
+        {
+            if (i < FlexBuffer->SpinCount)
             {
-                /* Prevent from infinite wait if (Time - Now == INFINITE),
-                 * which is probably possible on a multi-core CPU system. 
-                 */
-                Timeout = (uint32_t)min(Time - Now, FLEX_INFINITE - 1);
+                FLEX_Cpu_Pause();
             }
             else
-                Timeout = 0; /* Time in the past */
+                FLEX_Thread_Yield();
+
+            if (LockFree)
+            {
+                Actual = FLEX_Length(FlexBuffer, Side, Length);
+                continue;
+            }
+
+            if (FLEX_Atomic_Load(Peer) == Seen)
+                continue;
+
+            if (!FLEX_Lock(FlexBuffer))
+            {
+                /* This should never happen in practice */
+                return 0;
+            }
+
+            Actual = FLEX_Length(FlexBuffer, Side, Length);
+            Seen = FLEX_Atomic_Load(Peer);
+
+            if (Actual >= Length)
+                return Actual;
+
+            FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
         }
 
-        Ret = FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        if (!LockFree)
+        {
+            if (!FLEX_Lock(FlexBuffer))
+            {
+                /* This should never happen in practice */
+                return 0;
+            }
+
+            Actual = FLEX_Length(FlexBuffer, Side, Length);
+        }
 
-        if (Ret)
+        if (Actual >= Length)
+            return Actual;
+    }
+
+    uint64_t Time;
+
+    if (Deadline)
+    {
+        Time = *Deadline;
+    }
+    else if (Milliseconds == FLEX_INFINITE)
+    {
+        Time = FLEX_DEADLINE_INFINITE;
+    }
+    else
+        Time = FLEX_Clock_Now() + Milliseconds * 1000000ULL; /* Wait will be terminated at Time */
+
+    int Result = 0;
+
+    if (LockFree)
+    {
+        volatile size_t *Waiting = &FLEX_GetCursor(FlexBuffer, Side)->Waiting;
+
+        while (Result == 0)
+        {
+            /* Pairs with the fence in FLEX_Wake. Either the waker sees the
+             * flag, or the length re-read below sees the new index.
+             */
+            FLEX_Atomic_Store(Waiting, 1);
+            FLEX_Atomic_Fence();
+
+            Actual = FLEX_Length(FlexBuffer, Side, Length);
+
+            if (Actual >= Length)
+                break;
+
+            Result = FLEX_Park(FlexBuffer, Side, Time);
+        }
+
+        FLEX_Atomic_Store(Waiting, 0);
+
+        return FLEX_Length(FlexBuffer, Side, Length);
+    }
+
+#ifndef _WIN32
+    struct timespec Ts;
+
+    Ts.tv_sec  = (time_t)(Time / 1000000000ULL);
+    Ts.tv_nsec = (long)(Time % 1000000000ULL);
+#endif
+
+    /* Tell the peer to signal, the count is protected by the mutex */
+    FlexBuffer->Cursor[Side].Waiting++;
+
+    while (Actual < Length && Result == 0)
+    {
+#ifdef _WIN32
+        uint32_t Timeout = FLEX_Remaining(Time);
+
+        if (FLEX_Mutex_Unlock(&FlexBuffer->Mutex))
             break;
 
-        /* There is no native CV implementation on Windows before 
+        /* There is no native CV implementation on Windows before
          * Vista. CV is emulated on Windows with non-atomic mutex
-         * unlock and wait. 
+         * unlock and wait.
          *
          * Event state on Windows is preserved even if no wait is
          * on going, which is different from CV whose signal must
          * be sent when there goes a wait (or the signal would be
-         * lost). 
+         * lost).
          *
          * In this case, non-atomic operation should work with no
          * problem.
          */
 
-        Result = FLEX_Event_Wait(&FlexBuffer->Event[0], Timeout);
-
-        Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
+        Result = FLEX_Event_Wait(&FlexBuffer->Event[Side], Timeout);
 
-        if (Ret)
+        if (FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE))
         {
             /* This should never happen in practice */
-            return NULL;
+            FlexBuffer->Cursor[Side].Waiting--;
+            return 0;
         }
 #else
-        if (Milliseconds != FLEX_INFINITE)
+        Result = FLEX_Event_Wait(&FlexBuffer->Event[Side], &FlexBuffer->Mutex,
+            Time == FLEX_DEADLINE_INFINITE ? NULL : &Ts);
+#endif
+
+        Actual = FLEX_Length(FlexBuffer, Side, Length);
+    }
+
+    FlexBuffer->Cursor[Side].Waiting--;
+
+    return Actual;
+}
+
+/* Signal Side if it is sleeping or has armed its event fd, and return
+ * whether a signal has been sent. In locked mode the mutex is held by
+ * the caller.
+ */
+static bool FLEX_Signal(FLEX_BUFFER *FlexBuffer, int Side)
+{
+    FLEX_CURSOR *Cursor = FLEX_GetCursor(FlexBuffer, Side);
+
+    volatile size_t *Waiting = &Cursor->Waiting;
+    volatile size_t *Armed = &Cursor->Armed;
+
+    bool LockFree = (FlexBuffer->Flags & FLEX_FLAG_LOCKFREE) != 0;
+    bool Signaled = false;
+
+    if (LockFree)
+    {
+        FLEX_Atomic_Fence();
+    }
+
+    if ((FlexBuffer->Flags & FLEX_FLAG_EVENTFD) && FLEX_Atomic_Load(Armed))
+    {
+        FLEX_Atomic_Store(Armed, 0);
+        FLEX_Event_Notify(FLEX_GetEvent(FlexBuffer, Side));
+
+        Signaled = true;
+    }
+
+    if (FLEX_Atomic_Load(Waiting))
+    {
+        if (!LockFree)
         {
-            Result = pthread_cond_timedwait(&FlexBuffer->Event[0], &FlexBuffer->Mutex, &Ts);
+            FLEX_Event_Signal(FLEX_GetEvent(FlexBuffer, Side));
         }
         else
-            Result = pthread_cond_wait(&FlexBuffer->Event[0], &FlexBuffer->Mutex);
+        {
+            /* Clear the flag first so that a waiter about to park returns at once */
+            FLEX_Atomic_Store(Waiting, 0);
+
+#ifdef _WIN32
+            FLEX_Event_Signal(FLEX_GetEvent(FlexBuffer, Side));
+#else
+            FLEX_Futex_Wake(Waiting, FlexBuffer->Shared != NULL);
 #endif
+        }
+
+        Signaled = true;
     }
 
-    size_t Actual = FlexBuffer->Length;
+    return Signaled;
+}
 
-    if (Actual > Length)
+/* Count a signal sent or skipped. Several producers, or readers moving
+ * Cursor[1], may count on the same cursor at once.
+ */
+static inline void FLEX_Count(FLEX_CURSOR *Cursor, bool Signaled)
+{
+    FLEX_Atomic_Add(Signaled ? &Cursor->Signaled : &Cursor->Elided, 1);
+}
+
+/* Wake up Side after the peer index is published. The signal is only
+ * sent when Side is sleeping, and the event fd is only raised when Side
+ * has armed it, so a Put does not enter the kernel while both sides are
+ * busy.
+ */
+static void FLEX_Wake(FLEX_BUFFER *FlexBuffer, int Side)
+{
+    /* Counters belong to the waking side */
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[!Side];
+
+    /* In broadcast mode, data is for every attached reader */
+    if (Side == 1 && FlexBuffer->Readers)
+    {
+        size_t i;
+
+        for (i = 0; i < FLEX_MAX_READERS; i++)
+        {
+            if (FLEX_Atomic_Load(&FlexBuffer->Readers[i].State) == FLEX_READER_ATTACHED)
+            {
+                FLEX_Wake(FlexBuffer, FLEX_READER_SIDE(i));
+            }
+        }
+
+        return;
+    }
+
+    FLEX_Count(Cursor, FLEX_Signal(FlexBuffer, Side));
+}
+
+/* Fill in range fields for Actual bytes starting at Index, no allocation required */
+static FLEX_RANGE *FLEX_FillRange(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Index, size_t Actual)
+{
+    size_t Position = Index;
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    Range[0].Data = &FlexBuffer->Data[Position];
+
+    /* Mirrored memory continues past the end of the buffer */
+    if (Position + Actual <= FlexBuffer->Size || (FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+    {
+        Range[0].Size = Actual;
+        Range[0].Next = NULL;
+    }
+    else
+    {
+        Range[0].Size = FlexBuffer->Size - Position;
+        Range[0].Next = &Range[1];
+
+        /* Wrap-around */
+        Range[1].Data = &FlexBuffer->Data[0];
+        Range[1].Size = Position + Actual - FlexBuffer->Size;
+        Range[1].Next = NULL;
+    }
+
+    return Range;
+}
+
+/* Store a published index in the header of a file-backed buffer. Data is
+ * written to the mapping before, so the file never has an index ahead.
+ */
+static inline void FLEX_Persist(FLEX_BUFFER *FlexBuffer, int Side)
+{
+    if (FlexBuffer->Header)
+    {
+        FlexBuffer->Header->Index[Side] = FlexBuffer->Cursor[Side].Index;
+    }
+}
+
+/* Add Length bytes from Index to the checksum of a side, before the side
+ * publishes them with its index
+ */
+static void FLEX_Checksum(FLEX_BUFFER *FlexBuffer, int Side, size_t Index, size_t Length)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[Side];
+
+    size_t Position = Index;
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    uint32_t Crc = (uint32_t)Cursor->Crc;
+
+    if (Position + Length <= FlexBuffer->Size || (FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+    {
+        Crc = FLEX_Crc32c(Crc, &FlexBuffer->Data[Position], Length);
+    }
+    else
+    {
+        /* Wrap-around */
+        Crc = FLEX_Crc32c(Crc, &FlexBuffer->Data[Position], FlexBuffer->Size - Position);
+        Crc = FLEX_Crc32c(Crc, &FlexBuffer->Data[0], Position + Length - FlexBuffer->Size);
+    }
+
+    /* Release stores keep the odd sequence ahead of the new values */
+    FLEX_Atomic_Store(&Cursor->CrcSeq, Cursor->CrcSeq + 1);
+    FLEX_Atomic_Store(&Cursor->Crc, Crc);
+    FLEX_Atomic_Store64(&Cursor->CrcBytes, Cursor->CrcBytes + Length);
+    FLEX_Atomic_Store(&Cursor->CrcSeq, Cursor->CrcSeq + 1);
+}
+
+/* Read a consistent checksum of a side */
+static void FLEX_ReadChecksum(FLEX_BUFFER *FlexBuffer, int Side, uint32_t *Crc, uint64_t *Bytes)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[Side];
+
+    for (;;)
+    {
+        size_t Seq = FLEX_Atomic_Load(&Cursor->CrcSeq);
+
+        if (Seq & 1)
+        {
+            FLEX_Thread_Yield();
+            continue;
+        }
+
+        *Crc = (uint32_t)FLEX_Atomic_Load(&Cursor->Crc);
+        *Bytes = FLEX_Atomic_Load64(&Cursor->CrcBytes);
+
+        if (FLEX_Atomic_Load(&Cursor->CrcSeq) == Seq)
+            break;
+    }
+}
+
+/* Release the whole pages of Length bytes from Index */
+static size_t FLEX_ReleaseSpan(FLEX_BUFFER *FlexBuffer, size_t Index, size_t Length)
+{
+    size_t Position = Index;
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    if (Position + Length <= FlexBuffer->Size)
+    {
+        return FLEX_Pages_Release(&FlexBuffer->Data[Position], Length);
+    }
+
+    /* Wrap-around */
+    return FLEX_Pages_Release(&FlexBuffer->Data[Position], FlexBuffer->Size - Position) +
+        FLEX_Pages_Release(&FlexBuffer->Data[0], Position + Length - FlexBuffer->Size);
+}
+
+/* Pass Length bytes read by the consumer back to the producer */
+static void FLEX_Consume(FLEX_BUFFER *FlexBuffer, size_t Length)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (FlexBuffer->Flags & FLEX_FLAG_CRC32C)
+    {
+        FLEX_Checksum(FlexBuffer, 1, Cursor->Index, Length);
+    }
+
+    /* The producer does not touch consumed pages before the index moves */
+    if (FlexBuffer->Flags & FLEX_FLAG_ELASTIC)
+    {
+        size_t Index = FLEX_Forward(FlexBuffer, Cursor->Index, Length);
+
+        if (FLEX_Distance(FlexBuffer, Index, FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index)) <= FlexBuffer->ElasticThreshold)
+        {
+            FLEX_ReleaseSpan(FlexBuffer, Cursor->Index, Length);
+        }
+    }
+
+    /* Publish consumed space to the producer */
+    FLEX_Atomic_Store(&Cursor->Index, FLEX_Forward(FlexBuffer, Cursor->Index, Length));
+
+    FLEX_Persist(FlexBuffer, 1);
+
+    /* Scanned bytes are counted from the read index */
+    Cursor->Scanned -= (Length < Cursor->Scanned) ? Length : Cursor->Scanned;
+
+    FLEX_Wake(FlexBuffer, 0);
+}
+
+/* Publish Length bytes written by the producer to the consumer */
+static void FLEX_Produce(FLEX_BUFFER *FlexBuffer, size_t Length)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[0];
+
+    if (FlexBuffer->Flags & FLEX_FLAG_CRC32C)
+    {
+        FLEX_Checksum(FlexBuffer, 0, Cursor->Index, Length);
+    }
+
+    FLEX_Atomic_Store(&Cursor->Index, FLEX_Forward(FlexBuffer, Cursor->Index, Length));
+
+    FLEX_Persist(FlexBuffer, 0);
+
+    FLEX_Wake(FlexBuffer, 1);
+}
+
+/* Reset reservation slots, slot i waits for reservation i first */
+static void FLEX_ResetSlots(FLEX_BUFFER *FlexBuffer)
+{
+    size_t i;
+
+    for (i = 0; i < FLEX_SLOTS; i++)
+    {
+        memset(&FlexBuffer->Slots[i], 0, sizeof(FLEX_SLOT));
+
+        FLEX_Atomic_Store(&FlexBuffer->Slots[i].Turn, i);
+    }
+
+    FlexBuffer->Reserve = 0;
+
+    FLEX_Atomic_Store(&FlexBuffer->Published, 0);
+    FLEX_Atomic_Store(&FlexBuffer->Publishing, 0);
+}
+
+/* Find the slot holding Range, NULL if Range is not a reservation */
+static FLEX_SLOT *FLEX_FindSlot(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range)
+{
+    uint8_t *Base = (uint8_t *)FlexBuffer->Slots;
+
+    if ((uint8_t *)Range < Base || (uint8_t *)Range >= Base + FLEX_SLOTS * sizeof(FLEX_SLOT))
+    {
+        return NULL;
+    }
+
+    FLEX_SLOT *Slot = &FlexBuffer->Slots[((uint8_t *)Range - Base) / sizeof(FLEX_SLOT)];
+
+    return (Range == Slot->Range) ? Slot : NULL;
+}
+
+/* Reserve a range in multi-reserve mode. With multiple producers, the
+ * reservation word is moved with a CAS rather than a plain fetch-add, so
+ * that a reservation never exceeds the free length and a producer may
+ * time out without leaving a hole in the stream.
+ */
+static FLEX_RANGE *FLEX_Reserve(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial,
+    uint32_t Milliseconds, const uint64_t *Deadline)
+{
+    uint64_t Time;
+
+    for (;;)
+    {
+        uint64_t Reserve = FLEX_Atomic_Load64(&FlexBuffer->Reserve);
+
+        size_t Actual = FLEX_ReserveLength(FlexBuffer, Reserve);
+
+        if (Actual < Length)
+        {
+            /* Other producers may take the space first, so the wait can
+             * be repeated. Turn a timeout into a deadline only once.
+             */
+            if (!Deadline && Milliseconds)
+            {
+                if (Milliseconds == FLEX_INFINITE)
+                {
+                    Time = FLEX_DEADLINE_INFINITE;
+                }
+                else
+                    Time = FLEX_Clock_Now() + Milliseconds * 1000000ULL;
+
+                Deadline = &Time;
+            }
+
+            if (Deadline && (*Deadline == FLEX_DEADLINE_INFINITE || FLEX_Clock_Now() < *Deadline))
+            {
+                FLEX_Wait(FlexBuffer, 0, Length, 0, Deadline);
+                continue;
+            }
+
+            if (!Partial || !Actual)
+                return NULL;
+        }
+        else
+            Actual = Length;
+
+        size_t Seq = (size_t)(Reserve >> FLEX_INDEX_BITS);
+        size_t Index = (size_t)(Reserve & FLEX_INDEX_MASK);
+        size_t End = FLEX_Forward(FlexBuffer, Index, Actual);
+
+        uint64_t Next = ((uint64_t)((Seq + 1) & FLEX_SEQ_MASK) << FLEX_INDEX_BITS) | End;
+
+        if (FlexBuffer->Flags & FLEX_FLAG_MULTI_PRODUCER)
+        {
+            if (!FLEX_Atomic_CompareExchange64(&FlexBuffer->Reserve, Reserve, Next))
+                continue;
+        }
+        else
+            FLEX_Atomic_Store64(&FlexBuffer->Reserve, Next); /* Nobody else moves it */
+
+        FLEX_SLOT *Slot = &FlexBuffer->Slots[Seq % FLEX_SLOTS];
+
+        Slot->Start = Index;
+        Slot->End = End;
+
+        FLEX_Atomic_Store(&Slot->State, FLEX_SLOT_RESERVED);
+
+        return FLEX_FillRange(FlexBuffer, Slot->Range, Index, Actual);
+    }
+}
+
+/* Publish committed slots to the consumer in reservation order. Only one
+ * producer publishes at a time, and a producer that finds another one
+ * publishing leaves its slot to that one, which checks again when done.
+ */
+static void FLEX_Publish(FLEX_BUFFER *FlexBuffer)
+{
+    bool Published = false;
+
+    for (;;)
+    {
+        /* The CAS is a full barrier, ordered after the committed state */
+        if (!FLEX_Atomic_CompareExchange(&FlexBuffer->Publishing, 0, 1))
+            break;
+
+        size_t Seq = FlexBuffer->Published;
+
+        FLEX_SLOT *Slot = &FlexBuffer->Slots[Seq % FLEX_SLOTS];
+
+        while (FLEX_Atomic_Load(&Slot->Turn) == Seq && FLEX_Atomic_Load(&Slot->State) == FLEX_SLOT_COMMITTED)
+        {
+            if (FlexBuffer->Flags & FLEX_FLAG_CRC32C)
+            {
+                FLEX_Checksum(FlexBuffer, 0, FlexBuffer->Cursor[0].Index,
+                    FLEX_Distance(FlexBuffer, FlexBuffer->Cursor[0].Index, Slot->End));
+            }
+
+            FLEX_Atomic_Store(&FlexBuffer->Cursor[0].Index, Slot->End);
+
+            /* Hand the slot over to reservation (Seq + FLEX_SLOTS) */
+            Slot->State = FLEX_SLOT_FREE;
+            FLEX_Atomic_Store(&Slot->Turn, (Seq + FLEX_SLOTS) & FLEX_SEQ_MASK);
+
+            Seq = (Seq + 1) & FLEX_SEQ_MASK;
+            Slot = &FlexBuffer->Slots[Seq % FLEX_SLOTS];
+
+            Published = true;
+        }
+
+        FLEX_Atomic_Store(&FlexBuffer->Published, Seq);
+
+        FLEX_Atomic_Store(&FlexBuffer->Publishing, 0);
+        FLEX_Atomic_Fence();
+
+        /* Pairs with the CAS above, a slot committed meanwhile is seen here */
+        if (FLEX_Atomic_Load(&Slot->Turn) != Seq || FLEX_Atomic_Load(&Slot->State) != FLEX_SLOT_COMMITTED)
+            break;
+    }
+
+    if (Published)
+    {
+        FLEX_Wake(FlexBuffer, 1);
+
+        /* Producers may be waiting for a slot */
+        FLEX_Count(&FlexBuffer->Cursor[0], FLEX_Signal(FlexBuffer, 0));
+    }
+}
+
+/* Commit the first Length bytes of a reservation in multi-reserve mode.
+ * Only the latest reservation can be shortened, by moving the reservation
+ * word back, as later ones already follow it.
+ */
+static bool FLEX_Commit(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Length)
+{
+    FLEX_SLOT *Slot = FLEX_FindSlot(FlexBuffer, Range);
+
+    if (!Slot || FLEX_Atomic_Load(&Slot->State) != FLEX_SLOT_RESERVED)
+    {
+        return false;
+    }
+
+    if (Length < FLEX_Distance(FlexBuffer, Slot->Start, Slot->End))
+    {
+        /* The slot turn is the sequence of its reservation */
+        uint64_t Seq = (uint64_t)((Slot->Turn + 1) & FLEX_SEQ_MASK) << FLEX_INDEX_BITS;
+        size_t End = FLEX_Forward(FlexBuffer, Slot->Start, Length);
+
+        if (!FLEX_Atomic_CompareExchange64(&FlexBuffer->Reserve, Seq | Slot->End, Seq | End))
+        {
+            return false;
+        }
+
+        Slot->End = End;
+    }
+
+    FLEX_Atomic_Store(&Slot->State, FLEX_SLOT_COMMITTED);
+
+    FLEX_Publish(FlexBuffer);
+
+    return true;
+}
+
+/* Find reader by its identifier, NULL if not in broadcast mode */
+static inline FLEX_READER *FLEX_FindReader(FLEX_BUFFER *FlexBuffer, int Reader)
+{
+    if (!FlexBuffer || !FlexBuffer->Readers || Reader < 0 || Reader >= FLEX_MAX_READERS)
+    {
+        return NULL;
+    }
+
+    return &FlexBuffer->Readers[Reader];
+}
+
+/* Index of the slowest attached reader, or the write index if there is
+ * none. Attached readers never fall behind Cursor[1], so the slowest one
+ * is the nearest to it.
+ */
+static size_t FLEX_Slowest(FLEX_BUFFER *FlexBuffer, bool Lossy)
+{
+    size_t i;
+
+    size_t RdIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+    size_t Index = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
+    size_t Distance = FLEX_Distance(FlexBuffer, RdIndex, Index);
+
+    for (i = 0; i < FLEX_MAX_READERS; i++)
+    {
+        FLEX_READER *Reader = &FlexBuffer->Readers[i];
+
+        if (FLEX_Atomic_Load(&Reader->State) != FLEX_READER_ATTACHED || (Reader->Lossy && !Lossy))
+        {
+            continue;
+        }
+
+        size_t Current = FLEX_Atomic_Load(&Reader->Cursor.Index);
+
+        if (FLEX_Distance(FlexBuffer, RdIndex, Current) < Distance)
+        {
+            Index = Current;
+            Distance = FLEX_Distance(FlexBuffer, RdIndex, Current);
+        }
+    }
+
+    return Index;
+}
+
+/* Evict lossy readers which keep the producer from Length bytes of free
+ * buffer, if the other readers do not keep it anyway. Called by the
+ * producer while moving Cursor[1].
+ */
+static void FLEX_Evict(FLEX_BUFFER *FlexBuffer, size_t Length)
+{
+    size_t i;
+
+    size_t WrIndex = FlexBuffer->Cursor[0].Index;
+
+    if (FlexBuffer->Size - FLEX_Distance(FlexBuffer, FLEX_Slowest(FlexBuffer, false), WrIndex) < Length)
+    {
+        return;
+    }
+
+    for (i = 0; i < FLEX_MAX_READERS; i++)
+    {
+        FLEX_READER *Reader = &FlexBuffer->Readers[i];
+
+        if (!Reader->Lossy || FLEX_Atomic_Load(&Reader->State) != FLEX_READER_ATTACHED)
+        {
+            continue;
+        }
+
+        size_t Index = FLEX_Atomic_Load(&Reader->Cursor.Index);
+
+        /* The CAS is a full barrier, the buffer is not written before it */
+        if (FlexBuffer->Size - FLEX_Distance(FlexBuffer, Index, WrIndex) < Length &&
+            FLEX_Atomic_CompareExchange(&Reader->State, FLEX_READER_ATTACHED, FLEX_READER_EVICTED))
+        {
+            FLEX_Count(&FlexBuffer->Cursor[0], FLEX_Signal(FlexBuffer, FLEX_READER_SIDE(i)));
+        }
+    }
+}
+
+/* Move Cursor[1] to the slowest attached reader. Only one thread moves it
+ * at a time, and a reader that finds another one moving it leaves the
+ * work to that one, which checks again when done. The producer (Side 0)
+ * waits for its turn instead, and evicts lossy readers if it is short
+ * of Length bytes.
+ */
+static void FLEX_Retire(FLEX_BUFFER *FlexBuffer, int Side, size_t Length)
+{
+    bool Moved = false;
+
+    for (;;)
+    {
+        /* The CAS is a full barrier, ordered after the reader index */
+        if (!FLEX_Atomic_CompareExchange(&FlexBuffer->Retiring, 0, 1))
+        {
+            if (Side != 0)
+                break;
+
+            FLEX_Thread_Yield();
+            continue;
+        }
+
+        if (Length)
+        {
+            FLEX_Evict(FlexBuffer, Length);
+            Length = 0;
+        }
+
+        size_t Index = FLEX_Slowest(FlexBuffer, true);
+
+        if (Index != FlexBuffer->Cursor[1].Index)
+        {
+            FLEX_Atomic_Store(&FlexBuffer->Cursor[1].Index, Index);
+            Moved = true;
+        }
+
+        FLEX_Atomic_Store(&FlexBuffer->Retiring, 0);
+        FLEX_Atomic_Fence();
+
+        /* Pairs with the CAS above, a reader moved meanwhile is seen here */
+        if (FLEX_Slowest(FlexBuffer, true) == FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index))
+            break;
+    }
+
+    if (Moved && Side != 0)
+    {
+        FLEX_Wake(FlexBuffer, 0);
+    }
+}
+
+FLEX_BUFFER *FLEX_CreateBuffer(size_t Size, size_t Alignment)
+{
+    return FLEX_CreateBufferEx(Size, Alignment, 0);
+}
+
+/* Map the header page and data of a file-backed buffer, and resume from
+ * the indices of the header if the file holds a buffer of the same layout.
+ */
+static bool FLEX_MapFile(FLEX_BUFFER *FlexBuffer, const char *Path)
+{
+    size_t PageSize = FLEX_Page_Size();
+
+    if (FlexBuffer->Size > SIZE_MAX - PageSize)
+    {
+        return false;
+    }
+
+    bool Created;
+
+    FlexBuffer->MapSize = PageSize + FlexBuffer->Size;
+    FlexBuffer->Header = (FLEX_HEADER *)FLEX_File_Map(Path, FlexBuffer->MapSize, &Created);
+
+    if (!FlexBuffer->Header)
+    {
+        return false;
+    }
+
+    FlexBuffer->Data = (uint8_t *)FlexBuffer->Header + PageSize;
+
+    FLEX_HEADER *Header = FlexBuffer->Header;
+
+    uint32_t Flags = FlexBuffer->Flags & FLEX_HEADER_FLAGS;
+
+    /* A new file reads as zeros, anything else must be a buffer of the same layout */
+    if (Header->Magic == 0)
+    {
+        Header->Size = FlexBuffer->Size;
+        Header->Flags = Flags;
+        Header->Index[0] = 0;
+        Header->Index[1] = 0;
+
+        Header->Magic = FLEX_HEADER_MAGIC;
+        return true;
+    }
+
+    if (Header->Magic != FLEX_HEADER_MAGIC || Header->Size != FlexBuffer->Size || Header->Flags != Flags)
+    {
+        return false;
+    }
+
+    size_t WrIndex = (size_t)Header->Index[0];
+    size_t RdIndex = (size_t)Header->Index[1];
+
+    if (WrIndex >= 2 * FlexBuffer->Size || RdIndex >= 2 * FlexBuffer->Size ||
+        FLEX_Distance(FlexBuffer, RdIndex, WrIndex) > FlexBuffer->Size)
+    {
+        return false;
+    }
+
+    FlexBuffer->Cursor[0].Index = WrIndex;
+    FlexBuffer->Cursor[0].Cached = RdIndex;
+    FlexBuffer->Cursor[1].Index = RdIndex;
+    FlexBuffer->Cursor[1].Cached = WrIndex;
+
+    return true;
+}
+
+/* Offset of the data in shared memory, after the control block */
+static inline size_t FLEX_SharedOffset(void)
+{
+    size_t PageSize = FLEX_Page_Size();
+
+    return (sizeof(FLEX_SHARED) + PageSize - 1) / PageSize * PageSize;
+}
+
+/* Create shared memory for the control block and the data, and move the
+ * cursors into it. Name is NULL for anonymous memory passed by its fd.
+ */
+static bool FLEX_MapShared(FLEX_BUFFER *FlexBuffer, const char *Name)
+{
+    size_t Offset = FLEX_SharedOffset();
+
+    if (FlexBuffer->Size > SIZE_MAX - Offset)
+    {
+        return false;
+    }
+
+    if (Name)
+    {
+        FlexBuffer->SharedName = (char *)malloc(strlen(Name) + 1);
+
+        if (!FlexBuffer->SharedName)
+            return false;
+
+        strcpy(FlexBuffer->SharedName, Name);
+    }
+
+    FlexBuffer->MapSize = Offset + FlexBuffer->Size;
+    FlexBuffer->Shared = (FLEX_SHARED *)FLEX_Shared_Create(Name, FlexBuffer->MapSize, &FlexBuffer->SharedFd);
+
+    if (!FlexBuffer->Shared)
+    {
+        return false;
+    }
+
+    FLEX_SHARED *Shared = FlexBuffer->Shared;
+
+    /* New memory reads as zeros, as Local does */
+    memcpy(Shared->Cursor, FlexBuffer->Local, sizeof(Shared->Cursor));
+
+    Shared->Size = FlexBuffer->Size;
+    Shared->Flags = FlexBuffer->Flags & ~FLEX_FLAG_PAGES;
+
+    FlexBuffer->Cursor = Shared->Cursor;
+    FlexBuffer->Data = (uint8_t *)Shared + Offset;
+
+    /* Attaching processes check the magic last */
+    FLEX_Atomic_Fence();
+    Shared->Magic = FLEX_SHARED_MAGIC;
+
+    return true;
+}
+
+/* Map anonymous pages for the data, huge pages from the pool if asked for and any are free */
+static bool FLEX_MapPages(FLEX_BUFFER *FlexBuffer)
+{
+    size_t PageSize = FLEX_Page_Size();
+    size_t HugeSize = FLEX_Huge_Page_Size();
+
+    if (FlexBuffer->Alignment > PageSize)
+    {
+        return false;
+    }
+
+    if ((FlexBuffer->Flags & FLEX_FLAG_HUGE_PAGES) && HugeSize && FlexBuffer->Size <= SIZE_MAX - HugeSize)
+    {
+        FlexBuffer->PagesSize = (FlexBuffer->Size + HugeSize - 1) / HugeSize * HugeSize;
+        FlexBuffer->Data = (uint8_t *)FLEX_Pages_Malloc(FlexBuffer->PagesSize, true, false);
+
+        if (FlexBuffer->Data)
+        {
+            FlexBuffer->HugeTlb = true;
+            return true;
+        }
+    }
+
+    if (FlexBuffer->Size > SIZE_MAX - PageSize)
+    {
+        FlexBuffer->PagesSize = 0;
+        return false;
+    }
+
+    FlexBuffer->PagesSize = (FlexBuffer->Size + PageSize - 1) / PageSize * PageSize;
+    FlexBuffer->Data = (uint8_t *)FLEX_Pages_Malloc(FlexBuffer->PagesSize, false, (FlexBuffer->Flags & FLEX_FLAG_ELASTIC) != 0);
+
+    if (!FlexBuffer->Data)
+    {
+        FlexBuffer->PagesSize = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/* Apply page options to the data, and keep only the ones that took effect */
+static void FLEX_ApplyPages(FLEX_BUFFER *FlexBuffer)
+{
+    uint32_t Flags = FlexBuffer->Flags;
+    uint32_t Options = 0;
+    size_t Size = FlexBuffer->Size;
+
+    if (FlexBuffer->PagesSize)
+    {
+        Size = FlexBuffer->PagesSize;
+    }
+    else if (Flags & FLEX_FLAG_MIRROR)
+    {
+        Size = 2 * FlexBuffer->Size;
+    }
+
+    /* Pages from the pool are huge already */
+    if ((Flags & FLEX_FLAG_HUGE_PAGES) && !FlexBuffer->HugeTlb)
+        Options |= FLEX_PAGES_HUGE;
+
+    if (Flags & FLEX_FLAG_NUMA_MASK)
+        Options |= FLEX_PAGES_NODE;
+
+    if (Flags & FLEX_FLAG_LOCK_MEMORY)
+        Options |= FLEX_PAGES_LOCK;
+
+    if (Flags & FLEX_FLAG_PREFAULT)
+        Options |= FLEX_PAGES_PREFAULT;
+
+    uint32_t Applied = FLEX_Pages_Apply(FlexBuffer->Data, Size, Options, (int)(Flags >> FLEX_FLAG_NUMA_SHIFT) - 1);
+
+    if ((Options & FLEX_PAGES_HUGE) && !(Applied & FLEX_PAGES_HUGE))
+        Flags &= ~FLEX_FLAG_HUGE_PAGES;
+
+    if (!(Applied & FLEX_PAGES_NODE))
+        Flags &= ~FLEX_FLAG_NUMA_MASK;
+
+    if (!(Applied & FLEX_PAGES_LOCK))
+        Flags &= ~FLEX_FLAG_LOCK_MEMORY;
+
+    if (!(Applied & FLEX_PAGES_PREFAULT))
+        Flags &= ~FLEX_FLAG_PREFAULT;
+
+    FlexBuffer->Flags = Flags;
+}
+
+/* Allocate data of Size bytes, not backed by a file or shared memory */
+static void FLEX_AllocData(FLEX_BUFFER *FlexBuffer)
+{
+    uint32_t Flags = FlexBuffer->Flags;
+
+    if (Flags & FLEX_FLAG_MIRROR)
+    {
+        FlexBuffer->Data = (uint8_t *)FLEX_Mirror_Malloc(FlexBuffer->Size);
+    }
+    else if (Flags & (FLEX_FLAG_PAGES | FLEX_FLAG_ELASTIC))
+    {
+        FLEX_MapPages(FlexBuffer);
+    }
+    else if (FlexBuffer->Alignment)
+    {
+        FlexBuffer->Data = (uint8_t *)FLEX_Aligned_Malloc(FlexBuffer->Size, FlexBuffer->Alignment);
+    }
+    else
+        FlexBuffer->Data = (uint8_t *)malloc(FlexBuffer->Size);
+
+    if (FlexBuffer->Data && (Flags & FLEX_FLAG_PAGES))
+    {
+        FLEX_ApplyPages(FlexBuffer);
+    }
+}
+
+/* Free data allocated by FLEX_AllocData */
+static void FLEX_FreeData(FLEX_BUFFER *FlexBuffer, uint8_t *Data, size_t Size, size_t PagesSize)
+{
+    if (PagesSize)
+    {
+        FLEX_Pages_Free(Data, PagesSize);
+    }
+    else if (FlexBuffer->Flags & FLEX_FLAG_MIRROR)
+    {
+        FLEX_Mirror_Free(Data, Size);
+    }
+    else if (FlexBuffer->Alignment)
+    {
+        FLEX_Aligned_Free(Data);
+    }
+    else
+        free(Data);
+}
+
+static FLEX_BUFFER *FLEX_Create(size_t Size, size_t Alignment, uint32_t Flags, const char *Path, bool Shared)
+{
+    size_t i;
+
+    /* Indices run in [0, 2 * Size) */
+    if (!Size || Size > SIZE_MAX / 2)
+    {
+        return NULL;
+    }
+
+    /* Processes park on futexes of the shared cursors, they do not share a mutex */
+    if (Shared)
+    {
+        if (Flags & (FLEX_FLAG_MIRROR | FLEX_FLAG_EVENTFD | FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE | FLEX_FLAG_BROADCAST))
+        {
+            return NULL;
+        }
+
+        Flags |= FLEX_FLAG_LOCKFREE;
+    }
+
+    /* Released pages must be private, unlocked and not huge, and the free space
+     * must belong to one producer
+     */
+    if ((Flags & FLEX_FLAG_ELASTIC) && (Path || Shared ||
+        (Flags & (FLEX_FLAG_MIRROR | FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE | FLEX_FLAG_BROADCAST |
+        FLEX_FLAG_HUGE_PAGES | FLEX_FLAG_LOCK_MEMORY | FLEX_FLAG_PREFAULT))))
+    {
+        return NULL;
+    }
+
+    /* Only the single producer and consumer indices are kept in the file */
+    if (Path && !Shared && (Flags & (FLEX_FLAG_MIRROR | FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE | FLEX_FLAG_BROADCAST)))
+    {
+        return NULL;
+    }
+
+    /* Cursors must not share cache lines with each other */
+    FLEX_BUFFER *FlexBuffer = (FLEX_BUFFER *)FLEX_Aligned_Malloc(sizeof(FLEX_BUFFER), FLEX_CACHE_LINE);
+
+    if (!FlexBuffer)
+    {
+        return NULL;
+    }
+
+    memset(FlexBuffer, 0, sizeof(FLEX_BUFFER));
+
+    FlexBuffer->Cursor = FlexBuffer->Local;
+    FlexBuffer->ZeroCopyFd = -1;
+
+    int Ret = FLEX_CreateMutex(&FlexBuffer->Mutex);
+
+    if (Ret)
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        Ret = FLEX_CreateEvent(&FlexBuffer->Event[i]);
+        if (Ret)
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+    }
+
+    if (Flags & FLEX_FLAG_MIRROR)
+    {
+        size_t PageSize = FLEX_Page_Size();
+
+        /* Pages are always aligned */
+        Alignment = 0;
+
+        if (Size > SIZE_MAX / 2 - PageSize)
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        Size = (Size + PageSize - 1) / PageSize * PageSize;
+    }
+
+    if (Flags & FLEX_FLAG_RECORD)
+    {
+        /* Records are put by one producer and read by one consumer */
+        if (Flags & (FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE | FLEX_FLAG_BROADCAST))
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        /* Headers are aligned, so every record is */
+        if (Size > SIZE_MAX / 2 - FLEX_RECORD_ALIGN)
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        Size = (Size + FLEX_RECORD_ALIGN - 1) & ~(size_t)(FLEX_RECORD_ALIGN - 1);
+    }
+
+    if (Flags & FLEX_FLAG_EVENTFD)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            if (FLEX_CreateEventFd(&FlexBuffer->Event[i]))
+            {
+                FLEX_DeleteBuffer(FlexBuffer);
+                return NULL;
+            }
+
+            FlexBuffer->Cursor[i].Armed = 1;
+        }
+
+        /* The buffer starts writable */
+        FLEX_Event_Notify(&FlexBuffer->Event[0]);
+        FlexBuffer->Cursor[0].Armed = 0;
+    }
+
+    /* Readers do not pass data back through the consumer cursor */
+    if ((Flags & FLEX_FLAG_BROADCAST) && (Flags & FLEX_FLAG_CRC32C))
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    /* Readers do not have event fds and producers do not publish to them */
+    if ((Flags & FLEX_FLAG_BROADCAST) && (Flags & (FLEX_FLAG_EVENTFD | FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE)))
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    if (Flags & FLEX_FLAG_BROADCAST)
+    {
+        FlexBuffer->Readers = (FLEX_READER *)FLEX_Aligned_Malloc(FLEX_MAX_READERS * sizeof(FLEX_READER), FLEX_CACHE_LINE);
+
+        if (!FlexBuffer->Readers)
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        memset(FlexBuffer->Readers, 0, FLEX_MAX_READERS * sizeof(FLEX_READER));
+
+        for (i = 0; i < FLEX_MAX_READERS; i++)
+        {
+            if (FLEX_CreateEvent(&FlexBuffer->Readers[i].Event))
+            {
+                FLEX_DeleteBuffer(FlexBuffer);
+                return NULL;
+            }
+        }
+
+        /* Readers never take the mutex */
+        Flags |= FLEX_FLAG_LOCKFREE;
+    }
+
+    if (Flags & (FLEX_FLAG_MULTI_PRODUCER | FLEX_FLAG_MULTI_RESERVE))
+    {
+        /* Indices must fit in the reservation word */
+        if (Size >= (size_t)(FLEX_INDEX_MASK / 2))
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        FlexBuffer->Slots = (FLEX_SLOT *)FLEX_Aligned_Malloc(FLEX_SLOTS * sizeof(FLEX_SLOT), FLEX_CACHE_LINE);
+
+        if (!FlexBuffer->Slots)
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        FLEX_ResetSlots(FlexBuffer);
+
+        FlexBuffer->Depth = FLEX_SLOTS;
+
+        /* Producers never take the mutex */
+        Flags |= FLEX_FLAG_LOCKFREE;
+    }
+
+    FlexBuffer->Size = Size;
+    FlexBuffer->Alignment = Alignment;
+    FlexBuffer->Flags = Flags;
+
+    if (Shared)
+    {
+        if (!FLEX_MapShared(FlexBuffer, Path))
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+    }
+    else if (Path)
+    {
+        if (!FLEX_MapFile(FlexBuffer, Path))
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+
+        /* Resumed data was put before, by another instance */
+        if (Flags & FLEX_FLAG_CRC32C)
+        {
+            FLEX_Checksum(FlexBuffer, 0, FlexBuffer->Cursor[1].Index,
+                FLEX_Distance(FlexBuffer, FlexBuffer->Cursor[1].Index, FlexBuffer->Cursor[0].Index));
+        }
+
+        /* Resumed data is readable at once */
+        if ((Flags & FLEX_FLAG_EVENTFD) && FlexBuffer->Cursor[0].Index != FlexBuffer->Cursor[1].Index)
+        {
+            FLEX_Event_Notify(&FlexBuffer->Event[1]);
+            FlexBuffer->Cursor[1].Armed = 0;
+        }
+    }
+    else
+        FLEX_AllocData(FlexBuffer);
+
+    if (!FlexBuffer->Data)
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    /* FLEX_AllocData applies page options to memory it allocates. Pages of a
+     * regular file are not made huge by an advice.
+     */
+    if ((Shared || Path) && (Flags & FLEX_FLAG_PAGES))
+    {
+        if (!Shared)
+            FlexBuffer->Flags &= ~FLEX_FLAG_HUGE_PAGES;
+
+        FLEX_ApplyPages(FlexBuffer);
+    }
+
+    return FlexBuffer;
+}
+
+FLEX_BUFFER *FLEX_CreateBufferEx(size_t Size, size_t Alignment, uint32_t Flags)
+{
+    return FLEX_Create(Size, Alignment, Flags, NULL, false);
+}
+
+FLEX_BUFFER *FLEX_CreateFileBuffer(const char *Path, size_t Size, uint32_t Flags)
+{
+    if (!Path)
+    {
+        return NULL;
+    }
+
+    /* Data follows the header page, which is aligned */
+    return FLEX_Create(Size, 0, Flags, Path, false);
+}
+
+FLEX_BUFFER *FLEX_CreateSharedBuffer(const char *Name, size_t Size, uint32_t Flags)
+{
+    return FLEX_Create(Size, 0, Flags, Name, true);
+}
+
+/* Map shared memory of another process, which holds the cursors */
+static FLEX_BUFFER *FLEX_Attach(const char *Name, int Fd)
+{
+    size_t i;
+
+    FLEX_BUFFER *FlexBuffer = (FLEX_BUFFER *)FLEX_Aligned_Malloc(sizeof(FLEX_BUFFER), FLEX_CACHE_LINE);
+
+    if (!FlexBuffer)
+    {
+        return NULL;
+    }
+
+    memset(FlexBuffer, 0, sizeof(FLEX_BUFFER));
+
+    FlexBuffer->Cursor = FlexBuffer->Local;
+    FlexBuffer->ZeroCopyFd = -1;
+
+    /* Not used for waits, but deleted as usual */
+    if (FLEX_CreateMutex(&FlexBuffer->Mutex))
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (FLEX_CreateEvent(&FlexBuffer->Event[i]))
+        {
+            FLEX_DeleteBuffer(FlexBuffer);
+            return NULL;
+        }
+    }
+
+    FLEX_SHARED *Shared = (FLEX_SHARED *)FLEX_Shared_Attach(Name, Fd, &FlexBuffer->MapSize, &FlexBuffer->SharedFd);
+
+    if (!Shared)
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    FlexBuffer->Shared = Shared;
+
+    size_t Offset = FLEX_SharedOffset();
+
+    /* The creator fills in the control block before the magic */
+    bool Valid = FlexBuffer->MapSize >= Offset && FLEX_Atomic_Load64(&Shared->Magic) == FLEX_SHARED_MAGIC &&
+        Shared->Size && Shared->Size <= FlexBuffer->MapSize - Offset;
+
+    if (!Valid)
+    {
+        FLEX_DeleteBuffer(FlexBuffer);
+        return NULL;
+    }
+
+    FlexBuffer->Size = (size_t)Shared->Size;
+    FlexBuffer->Flags = Shared->Flags;
+    FlexBuffer->Cursor = Shared->Cursor;
+    FlexBuffer->Data = (uint8_t *)Shared + Offset;
+
+    return FlexBuffer;
+}
+
+FLEX_BUFFER *FLEX_AttachSharedBuffer(const char *Name)
+{
+    if (!Name)
+    {
+        return NULL;
+    }
+
+    return FLEX_Attach(Name, -1);
+}
+
+FLEX_BUFFER *FLEX_AttachSharedBufferFd(int Fd)
+{
+    if (Fd < 0)
+    {
+        return NULL;
+    }
+
+    return FLEX_Attach(NULL, Fd);
+}
+
+int FLEX_GetSharedFd(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer || !FlexBuffer->Shared)
+    {
+        return -1;
+    }
+
+    return FlexBuffer->SharedFd;
+}
+
+bool FLEX_SetElasticPolicy(FLEX_BUFFER *FlexBuffer, size_t Threshold, uint32_t IdleMs)
+{
+    if (!FlexBuffer || !(FlexBuffer->Flags & FLEX_FLAG_ELASTIC))
+    {
+        return false;
+    }
+
+    FlexBuffer->ElasticThreshold = Threshold;
+    FlexBuffer->ElasticIdle = IdleMs;
+
+    return true;
+}
+
+size_t FLEX_TrimBuffer(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer || !(FlexBuffer->Flags & FLEX_FLAG_ELASTIC))
+    {
+        return 0;
+    }
+
+    /* A held write range is in the free space */
+    if (FlexBuffer->Cursor[0].Dequeued)
+    {
+        return 0;
+    }
+
+    size_t WrIndex = FlexBuffer->Cursor[0].Index;
+    size_t RdIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+
+    uint64_t Now = FLEX_GetTime();
+
+    /* Wait for IdleMs without any data put or read */
+    if (WrIndex != FlexBuffer->TrimIndex[0] || RdIndex != FlexBuffer->TrimIndex[1] || !FlexBuffer->TrimTime)
+    {
+        FlexBuffer->TrimIndex[0] = WrIndex;
+        FlexBuffer->TrimIndex[1] = RdIndex;
+        FlexBuffer->TrimTime = Now;
+        FlexBuffer->Trimmed = false;
+    }
+
+    if (FlexBuffer->Trimmed || Now - FlexBuffer->TrimTime < (uint64_t)FlexBuffer->ElasticIdle * 1000000)
+    {
+        return 0;
+    }
+
+    FlexBuffer->Trimmed = true;
+
+    /* The consumer only reads up to the write index */
+    return FLEX_ReleaseSpan(FlexBuffer, WrIndex, FlexBuffer->Size - FLEX_Distance(FlexBuffer, RdIndex, WrIndex));
+}
+
+size_t FLEX_GetResidentBytes(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+    {
+        return 0;
+    }
+
+    return FLEX_Pages_Resident(FlexBuffer->Data, (FlexBuffer->Flags & FLEX_FLAG_MIRROR) ? 2 * FlexBuffer->Size : FlexBuffer->Size);
+}
+
+bool FLEX_GetWrChecksum(FLEX_BUFFER *FlexBuffer, uint32_t *Crc, uint64_t *Bytes)
+{
+    if (!FlexBuffer || !Crc || !Bytes || !(FlexBuffer->Flags & FLEX_FLAG_CRC32C))
+    {
+        return false;
+    }
+
+    FLEX_ReadChecksum(FlexBuffer, 0, Crc, Bytes);
+
+    return true;
+}
+
+bool FLEX_GetRdChecksum(FLEX_BUFFER *FlexBuffer, uint32_t *Crc, uint64_t *Bytes)
+{
+    if (!FlexBuffer || !Crc || !Bytes || !(FlexBuffer->Flags & FLEX_FLAG_CRC32C))
+    {
+        return false;
+    }
+
+    FLEX_ReadChecksum(FlexBuffer, 1, Crc, Bytes);
+
+    return true;
+}
+
+int FLEX_CompareChecksums(FLEX_BUFFER *FlexBuffer)
+{
+    uint32_t Crc[2];
+    uint64_t Bytes[2];
+
+    if (!FlexBuffer || !(FlexBuffer->Flags & FLEX_FLAG_CRC32C))
+    {
+        return -1;
+    }
+
+    FLEX_ReadChecksum(FlexBuffer, 1, &Crc[1], &Bytes[1]);
+    FLEX_ReadChecksum(FlexBuffer, 0, &Crc[0], &Bytes[0]);
+
+    /* Both checksums cover the same bytes only when all data is read */
+    if (Bytes[0] != Bytes[1])
+    {
+        return FLEX_CHECKSUM_PENDING;
+    }
+
+    return (Crc[0] == Crc[1]) ? FLEX_CHECKSUM_MATCH : FLEX_CHECKSUM_MISMATCH;
+}
+
+uint32_t FLEX_GetBufferFlags(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+    {
+        return 0;
+    }
+
+    return FlexBuffer->Flags;
+}
+
+bool FLEX_SyncBuffer(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer || !FlexBuffer->Header)
+    {
+        return false;
+    }
+
+    /* Data first, then the indices which refer to it */
+    if (FLEX_File_Sync(FlexBuffer->Data, FlexBuffer->Size))
+    {
+        return false;
+    }
+
+    return FLEX_File_Sync(FlexBuffer->Header, sizeof(FLEX_HEADER)) == 0;
+}
+
+void FLEX_DeleteBuffer(FLEX_BUFFER *FlexBuffer)
+{
+    size_t i;
+
+    if (!FlexBuffer)
+    {
+        return;
+    }
+
+    FLEX_DeleteMutex(&FlexBuffer->Mutex);
+
+    for (i = 0; i < 2; i++)
+    {
+        FLEX_DeleteEvent(&FlexBuffer->Event[i]);
+    }
+
+    if (FlexBuffer->Shared)
+    {
+        FLEX_Shared_Delete(FlexBuffer->Shared, FlexBuffer->MapSize, FlexBuffer->SharedFd, FlexBuffer->SharedName);
+    }
+    else if (FlexBuffer->Header)
+    {
+        FLEX_File_Unmap(FlexBuffer->Header, FlexBuffer->MapSize);
+    }
+    else if (FlexBuffer->Data)
+    {
+        FLEX_FreeData(FlexBuffer, FlexBuffer->Data, FlexBuffer->Size, FlexBuffer->PagesSize);
+    }
+
+    if (FlexBuffer->OldData)
+    {
+        FLEX_FreeData(FlexBuffer, FlexBuffer->OldData, FlexBuffer->OldSize, FlexBuffer->OldPagesSize);
+    }
+
+    if (FlexBuffer->Slots)
+    {
+        FLEX_Aligned_Free(FlexBuffer->Slots);
+    }
+
+    if (FlexBuffer->Readers)
+    {
+        for (i = 0; i < FLEX_MAX_READERS; i++)
+        {
+            FLEX_DeleteEvent(&FlexBuffer->Readers[i].Event);
+        }
+
+        FLEX_Aligned_Free(FlexBuffer->Readers);
+    }
+
+    if (FlexBuffer->SharedName)
+    {
+        free(FlexBuffer->SharedName);
+    }
+
+    FLEX_Aligned_Free(FlexBuffer);
+}
+
+void FLEX_RestoreBuffer(FLEX_BUFFER *FlexBuffer)
+{
+    size_t i, j;
+
+    if (!FlexBuffer)
+    {
+        return;
+    }
+
+    for (i = 0; i < 2 + (FlexBuffer->Readers ? FLEX_MAX_READERS : 0); i++)
+    {
+        FLEX_CURSOR *Cursor = FLEX_GetCursor(FlexBuffer, (int)i);
+
+        FLEX_Atomic_Store(&Cursor->Index, 0);
+
+        Cursor->Cached = 0;
+        Cursor->Record = 0;
+        Cursor->Scanned = 0;
+        Cursor->Held = 0;
+        Cursor->Transferring = false;
+
+        Cursor->CrcSeq = 0;
+        Cursor->Crc = 0;
+        Cursor->CrcBytes = 0;
+
+        for (j = 0; j < 2; j++)
+        {
+            memset(&Cursor->Range[j], 0, sizeof(FLEX_RANGE));
+        }
+
+        Cursor->Dequeued = false;
+    }
+
+    if (FlexBuffer->Slots)
+    {
+        FLEX_ResetSlots(FlexBuffer);
+    }
+
+    FLEX_Atomic_Store(&FlexBuffer->Retiring, 0);
+
+    FLEX_Persist(FlexBuffer, 0);
+    FLEX_Persist(FlexBuffer, 1);
+
+    /* Dropped transfers complete in vain, the socket keeps counting sends */
+    FlexBuffer->TransferHead = 0;
+    FlexBuffer->TransferCount = 0;
+
+    /* Ranges got before the last resize are dropped too */
+    if (FlexBuffer->OldData)
+    {
+        FLEX_FreeData(FlexBuffer, FlexBuffer->OldData, FlexBuffer->OldSize, FlexBuffer->OldPagesSize);
+
+        FlexBuffer->OldData = NULL;
+    }
+
+    FlexBuffer->Stale[0] = false;
+    FlexBuffer->Stale[1] = false;
+}
+
+static FLEX_RANGE *FLEX_GetBuffer(FLEX_BUFFER *FlexBuffer, int Side, size_t Length, bool Partial,
+    uint32_t Milliseconds, const uint64_t *Deadline)
+{
+    if (!FlexBuffer || !Length)
+    {
+        return NULL;
+    }
+
+    if (Side == 0 && FlexBuffer->Slots)
+    {
+        return FLEX_Reserve(FlexBuffer, Length, Partial, Milliseconds, Deadline);
+    }
+
+    /* Readers have their own cursors in broadcast mode */
+    if (Side == 1 && FlexBuffer->Readers)
+    {
+        return NULL;
+    }
+
+    /* Records are got by FLEX_GetRecord */
+    if (FlexBuffer->Flags & FLEX_FLAG_RECORD)
+    {
+        return NULL;
+    }
+
+    FLEX_CURSOR *Cursor = FLEX_GetCursor(FlexBuffer, Side);
+
+    if (!FLEX_Lock(FlexBuffer))
+        return NULL;
+
+    if (Cursor->Dequeued)
+    {
+        FLEX_Unlock(FlexBuffer);
+        return NULL;
+    }
+
+    FLEX_RANGE *Range = NULL;
+
+    size_t Actual = FLEX_Wait(FlexBuffer, Side, Length, Milliseconds, Deadline);
+
+    /* The reader may have been evicted while waiting */
+    if (Side >= 2 && FLEX_Atomic_Load(&FlexBuffer->Readers[Side - 2].State) != FLEX_READER_ATTACHED)
+    {
+        Actual = 0;
+    }
+
+    if (Actual > Length)
+    {
+        Actual = Length;
+    }
+
+    if (Actual < Length && !Partial)
+    {
+        Actual = 0;
+    }
+
+    /* Another thread may have dequeued while the mutex was released */
+    if (Actual && !Cursor->Dequeued)
+    {
+        Range = FLEX_FillRange(FlexBuffer, Cursor->Range, Cursor->Index, Actual);
+
+        /* Dequeued */
+        Cursor->Dequeued = true;
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Range;
+}
+
+FLEX_RANGE *FLEX_GetRdBlocks(FLEX_BUFFER *FlexBuffer, size_t Block, size_t *Count, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Block || !Count || !*Count || *Count > SIZE_MAX / Block)
+    {
+        return NULL;
+    }
+
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        return NULL;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+    FLEX_RANGE *Range = NULL;
+
+    size_t Length = *Count * Block;
+
+    if (!FLEX_Lock(FlexBuffer))
+        return NULL;
+
+    if (!Cursor->Dequeued)
+    {
+        /* Wait for one block only, then take all that has arrived */
+        size_t Actual = FLEX_Wait(FlexBuffer, 1, Block, Milliseconds, NULL);
+
+        if (Actual >= Block && Actual < Length)
+        {
+            Actual = FLEX_RdLength(FlexBuffer, Cursor, Length);
+        }
+
+        if (Actual > Length)
+        {
+            Actual = Length;
+        }
+
+        Actual -= Actual % Block;
+
+        /* Another thread may have dequeued while the mutex was released */
+        if (Actual && !Cursor->Dequeued)
+        {
+            Range = FLEX_FillRange(FlexBuffer, Cursor->Range, Cursor->Index, Actual);
+
+            Cursor->Dequeued = true;
+
+            *Count = Actual / Block;
+        }
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    if (!Range)
+    {
+        *Count = 0;
+    }
+
+    return Range;
+}
+
+/* Get a record to write of Length bytes, or the next record to read. The
+ * writer skips the rest of the buffer with a padding header when the
+ * record does not fit before the end, so that a record is never divided.
+ */
+static FLEX_RANGE *FLEX_GetRecord(FLEX_BUFFER *FlexBuffer, int Side, size_t Length,
+    uint32_t Milliseconds, const uint64_t *Deadline)
+{
+    if (!FlexBuffer || !(FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        return NULL;
+    }
+
+    if (Side == 0 && (!Length || Length > UINT32_MAX || FLEX_RECORD_LENGTH(Length) > FlexBuffer->Size))
+    {
+        return NULL;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[Side];
+
+    if (!FLEX_Lock(FlexBuffer))
+        return NULL;
+
+    if (Cursor->Dequeued)
+    {
+        FLEX_Unlock(FlexBuffer);
+        return NULL;
+    }
+
+    /* The padding is waited for apart from the record, both within one timeout */
+    uint64_t Time;
+
+    if (!Deadline)
+    {
+        Deadline = FLEX_Deadline(Milliseconds, &Time);
+    }
+
+    size_t Position = Cursor->Index;
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    FLEX_RECORD Record;
+
+    /* The reader needs a header first, which comes with the whole record */
+    size_t Need = sizeof(FLEX_RECORD);
+
+    if (Side == 0)
+    {
+        Need = FLEX_RECORD_LENGTH(Length);
+
+        /* Mirrored memory continues past the end of the buffer. Otherwise the
+         * rest of the buffer is padded and put on its own, so that the record
+         * then waits for its own length only.
+         */
+        if (Position + Need > FlexBuffer->Size && !(FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+        {
+            size_t Skip = FlexBuffer->Size - Position;
+
+            /* Another thread may have dequeued while the mutex was released */
+            if (FLEX_Wait(FlexBuffer, 0, Skip, Milliseconds, Deadline) < Skip || Cursor->Dequeued)
+            {
+                FLEX_Unlock(FlexBuffer);
+                return NULL;
+            }
+
+            Record.Length = (uint32_t)Skip;
+            Record.Padding = 1;
+
+            memcpy(&FlexBuffer->Data[Position], &Record, sizeof(FLEX_RECORD));
+
+            FLEX_Produce(FlexBuffer, Skip);
+        }
+    }
+    else
+    {
+        /* Padding is read as soon as it is put */
+        while (true)
+        {
+            if (FLEX_Wait(FlexBuffer, 1, Need, Milliseconds, Deadline) < Need || Cursor->Dequeued)
+            {
+                FLEX_Unlock(FlexBuffer);
+                return NULL;
+            }
+
+            memcpy(&Record, &FlexBuffer->Data[Position], sizeof(FLEX_RECORD));
+
+            if (!Record.Padding)
+                break;
+
+            FLEX_Consume(FlexBuffer, Record.Length);
+
+            Position = 0;
+        }
+    }
+
+    FLEX_RANGE *Range = NULL;
+
+    size_t Actual = FLEX_Wait(FlexBuffer, Side, Need, Milliseconds, Deadline);
+
+    /* Another thread may have dequeued while the mutex was released */
+    if (Actual >= Need && !Cursor->Dequeued)
+    {
+        /* The header is written by Put, when the length is known */
+        if (Side == 1)
+        {
+            Length = Record.Length;
+
+            Cursor->Record = FLEX_RECORD_LENGTH(Length);
+        }
+
+        Range = FLEX_FillRange(FlexBuffer, Cursor->Range, FLEX_Forward(FlexBuffer, Cursor->Index, sizeof(FLEX_RECORD)), Length);
+
+        /* Dequeued */
+        Cursor->Dequeued = true;
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Range;
+}
+
+/* Copy Length bytes from Index out of the buffer */
+static void FLEX_CopyData(FLEX_BUFFER *FlexBuffer, size_t Index, uint8_t *Data, size_t Length)
+{
+    size_t Position = Index;
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    size_t First = Length;
+
+    /* Mirrored memory continues past the end of the buffer */
+    if (Position + Length > FlexBuffer->Size && !(FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+    {
+        First = FlexBuffer->Size - Position;
+    }
+
+    memcpy(Data, &FlexBuffer->Data[Position], First);
+    memcpy(Data + First, &FlexBuffer->Data[0], Length - First);
+}
+
+/* Copy Length bytes of the ranges into the buffer at Index */
+static void FLEX_StoreRange(FLEX_BUFFER *FlexBuffer, size_t Index, FLEX_RANGE *Range, size_t Length)
+{
+    for (FLEX_RANGE *Part = Range; Part && Length; Part = Part->Next)
+    {
+        size_t Size = (Part->Size < Length) ? Part->Size : Length;
+        size_t Position = Index;
+
+        if (Position >= FlexBuffer->Size)
+            Position -= FlexBuffer->Size;
+
+        size_t First = Size;
+
+        if (Position + Size > FlexBuffer->Size && !(FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+        {
+            First = FlexBuffer->Size - Position;
+        }
+
+        memcpy(&FlexBuffer->Data[Position], Part->Data, First);
+        memcpy(&FlexBuffer->Data[0], Part->Data + First, Size - First);
+
+        Index = FLEX_Forward(FlexBuffer, Index, Size);
+        Length -= Size;
+    }
+}
+
+/* Side is done with the range it got before the last resize. The old
+ * data is freed when the other side is done too. Called under the mutex.
+ */
+static void FLEX_DropStale(FLEX_BUFFER *FlexBuffer, int Side)
+{
+    FlexBuffer->Stale[Side] = false;
+
+    if (!FlexBuffer->Stale[!Side] && FlexBuffer->OldData)
+    {
+        FLEX_FreeData(FlexBuffer, FlexBuffer->OldData, FlexBuffer->OldSize, FlexBuffer->OldPagesSize);
+
+        FlexBuffer->OldData = NULL;
+    }
+}
+
+/* Length of the frame starting at the read index, 0 if the length field
+ * is out of range. At least FrameOffset + FrameWidth bytes are readable.
+ */
+static size_t FLEX_FrameLength(FLEX_BUFFER *FlexBuffer)
+{
+    uint8_t Field[8];
+    uint64_t Value = 0;
+    size_t i;
+
+    size_t Header = FlexBuffer->FrameOffset + FlexBuffer->FrameWidth;
+
+    FLEX_CopyData(FlexBuffer, FLEX_Forward(FlexBuffer, FlexBuffer->Cursor[1].Index, FlexBuffer->FrameOffset),
+        Field, FlexBuffer->FrameWidth);
+
+    for (i = 0; i < FlexBuffer->FrameWidth; i++)
+    {
+        size_t Byte = FlexBuffer->FrameBigEndian ? i : FlexBuffer->FrameWidth - 1 - i;
+
+        Value = (Value << 8) | Field[Byte];
+    }
+
+    /* The frame must hold its header and fit in the buffer */
+    if (Value > FlexBuffer->Size)
+    {
+        return 0;
+    }
+
+    int64_t Length = (int64_t)(Header + Value) + FlexBuffer->FrameAdjust;
+
+    if (Length < (int64_t)Header || Length > (int64_t)FlexBuffer->Size)
+    {
+        return 0;
+    }
+
+    return (size_t)Length;
+}
+
+/* Search the pattern in Readable bytes of data from the read index, and
+ * return the length up to the end of the first match, or 0 if not found.
+ * Bytes already scanned are skipped, and a match across the end of the
+ * buffer is found in a copy of the bytes around it.
+ */
+static size_t FLEX_Scan(FLEX_BUFFER *FlexBuffer, FLEX_CURSOR *Cursor, size_t Readable)
+{
+    const uint8_t *Pattern = Cursor->Pattern;
+
+    size_t Length = Cursor->PatternLength;
+    size_t Offset = Cursor->Scanned;
+
+    if (Offset + Length > Readable)
+    {
+        return 0;
+    }
+
+    size_t Position = FLEX_Forward(FlexBuffer, Cursor->Index, Offset);
+
+    if (Position >= FlexBuffer->Size)
+        Position -= FlexBuffer->Size;
+
+    size_t Count = Readable - Offset;
+    size_t First = Count;
+
+    /* Mirrored memory continues past the end of the buffer */
+    if (Position + Count > FlexBuffer->Size && !(FlexBuffer->Flags & FLEX_FLAG_MIRROR))
+    {
+        First = FlexBuffer->Size - Position;
+    }
+
+    size_t Found = FLEX_Find_Pattern(&FlexBuffer->Data[Position], First, Pattern, Length);
+
+    if (Found < First)
+    {
+        return Offset + Found + Length;
+    }
+
+    if (First < Count)
+    {
+        uint8_t Joint[2 * FLEX_MAX_PATTERN];
+
+        size_t Head = (First < Length - 1) ? First : Length - 1;
+        size_t Tail = (Count - First < Length - 1) ? Count - First : Length - 1;
+
+        memcpy(Joint, &FlexBuffer->Data[FlexBuffer->Size - Head], Head);
+        memcpy(Joint + Head, &FlexBuffer->Data[0], Tail);
+
+        Found = FLEX_Find_Pattern(Joint, Head + Tail, Pattern, Length);
+
+        if (Found < Head + Tail)
+        {
+            return Offset + First - Head + Found + Length;
+        }
+
+        Found = FLEX_Find_Pattern(&FlexBuffer->Data[0], Count - First, Pattern, Length);
+
+        if (Found < Count - First)
+        {
+            return Offset + First + Found + Length;
+        }
+    }
+
+    /* A match may still start in the last (Length - 1) bytes */
+    Cursor->Scanned = Readable - (Length - 1);
+
+    return 0;
+}
+
+FLEX_RANGE *FLEX_GetWrBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    return FLEX_GetBuffer(FlexBuffer, 0, Length, Partial, Milliseconds, NULL);
+}
+
+FLEX_RANGE *FLEX_GetRdBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    return FLEX_GetBuffer(FlexBuffer, 1, Length, Partial, Milliseconds, NULL);
+}
+
+FLEX_RANGE *FLEX_GetWrBufferUntil(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint64_t Deadline)
+{
+    return FLEX_GetBuffer(FlexBuffer, 0, Length, Partial, 0, &Deadline);
+}
+
+FLEX_RANGE *FLEX_GetRdBufferUntil(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint64_t Deadline)
+{
+    return FLEX_GetBuffer(FlexBuffer, 1, Length, Partial, 0, &Deadline);
+}
+
+int FLEX_AttachReader(FLEX_BUFFER *FlexBuffer, bool Lossy)
+{
+    int i;
+
+    if (!FlexBuffer || !FlexBuffer->Readers)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < FLEX_MAX_READERS; i++)
+    {
+        if (FLEX_Atomic_CompareExchange(&FlexBuffer->Readers[i].State, FLEX_READER_FREE, FLEX_READER_CLAIMED))
+            break;
+    }
+
+    if (i == FLEX_MAX_READERS)
+    {
+        return -1;
+    }
+
+    FLEX_READER *Reader = &FlexBuffer->Readers[i];
+
+    /* Cursor[1] must not move past the reader before it is counted */
+    while (!FLEX_Atomic_CompareExchange(&FlexBuffer->Retiring, 0, 1))
+    {
+        FLEX_Thread_Yield();
+    }
+
+    /* Start with the data written from now on */
+    size_t Index = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
+
+    FLEX_Atomic_Store(&Reader->Cursor.Index, Index);
+
+    Reader->Cursor.Cached = Index;
+    Reader->Cursor.Dequeued = false;
+    Reader->Lossy = Lossy;
+
+    FLEX_Atomic_Store(&Reader->State, FLEX_READER_ATTACHED);
+    FLEX_Atomic_Store(&FlexBuffer->Retiring, 0);
+
+    /* Take over readers which left their work to this call */
+    FLEX_Retire(FlexBuffer, FLEX_READER_SIDE(i), 0);
+
+    return i;
+}
+
+bool FLEX_DetachReader(FLEX_BUFFER *FlexBuffer, int Reader)
+{
+    FLEX_READER *Item = FLEX_FindReader(FlexBuffer, Reader);
+
+    if (!Item)
+    {
+        return false;
+    }
+
+    size_t State = FLEX_Atomic_Load(&Item->State);
+
+    if (State != FLEX_READER_ATTACHED && State != FLEX_READER_EVICTED)
+    {
+        return false;
+    }
+
+    Item->Cursor.Dequeued = false;
+
+    FLEX_Atomic_Store(&Item->State, FLEX_READER_FREE);
+
+    /* The reader may have been the slowest one */
+    FLEX_Retire(FlexBuffer, FLEX_READER_SIDE(Reader), 0);
+
+    return true;
+}
+
+bool FLEX_IsReaderAttached(FLEX_BUFFER *FlexBuffer, int Reader)
+{
+    FLEX_READER *Item = FLEX_FindReader(FlexBuffer, Reader);
+
+    if (!Item)
+    {
+        return false;
+    }
+
+    return FLEX_Atomic_Load(&Item->State) == FLEX_READER_ATTACHED;
+}
+
+FLEX_RANGE *FLEX_GetReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    if (!FLEX_FindReader(FlexBuffer, Reader))
+    {
+        return NULL;
+    }
+
+    return FLEX_GetBuffer(FlexBuffer, FLEX_READER_SIDE(Reader), Length, Partial, Milliseconds, NULL);
+}
+
+FLEX_RANGE *FLEX_GetReaderBufferUntil(FLEX_BUFFER *FlexBuffer, int Reader, size_t Length, bool Partial, uint64_t Deadline)
+{
+    if (!FLEX_FindReader(FlexBuffer, Reader))
+    {
+        return NULL;
+    }
+
+    return FLEX_GetBuffer(FlexBuffer, FLEX_READER_SIDE(Reader), Length, Partial, 0, &Deadline);
+}
+
+bool FLEX_PutReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader, FLEX_RANGE *Range)
+{
+    if (!Range)
+    {
+        return false;
+    }
+
+    return FLEX_PutReaderBufferEx(FlexBuffer, Reader, Range, FLEX_RangeLength(Range));
+}
+
+bool FLEX_PutReaderBufferEx(FLEX_BUFFER *FlexBuffer, int Reader, FLEX_RANGE *Range, size_t Length)
+{
+    FLEX_READER *Item = FLEX_FindReader(FlexBuffer, Reader);
+
+    if (!Item || !Range || Length > FLEX_RangeLength(Range))
+    {
+        return false;
+    }
+
+    FLEX_CURSOR *Cursor = &Item->Cursor;
+
+    if (!Cursor->Dequeued)
+    {
+        return false;
+    }
+
+    /* Pairs with the CAS in FLEX_Evict. If the reader is still attached,
+     * the data read from the range has not been overwritten.
+     */
+    FLEX_Atomic_Fence();
+
+    if (FLEX_Atomic_Load(&Item->State) != FLEX_READER_ATTACHED)
+    {
+        Cursor->Dequeued = false;
+        return false;
+    }
+
+    if (FLEX_RangeLength(Range) > FLEX_RdLength(FlexBuffer, Cursor, FLEX_RangeLength(Range)))
+    {
+        return false;
+    }
+
+    Cursor->Dequeued = false;
+
+    if (!Length)
+    {
+        return true;
+    }
+
+    size_t Index = Cursor->Index;
+
+    FLEX_Atomic_Store(&Cursor->Index, FLEX_Forward(FlexBuffer, Index, Length));
+
+    /* Only the slowest reader moves Cursor[1]. The fence pairs with the
+     * one in FLEX_Retire, so either this reader sees Cursor[1] at its old
+     * index, or the thread moving it sees the new index.
+     */
+    FLEX_Atomic_Fence();
+
+    if (FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index) == Index)
+    {
+        FLEX_Retire(FlexBuffer, FLEX_READER_SIDE(Reader), 0);
+    }
+
+    return true;
+}
+
+bool FLEX_ReleaseReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader)
+{
+    FLEX_READER *Item = FLEX_FindReader(FlexBuffer, Reader);
+
+    if (!Item || !Item->Cursor.Dequeued)
+    {
+        return false;
+    }
+
+    Item->Cursor.Dequeued = false;
+
+    return true;
+}
+
+size_t FLEX_PeekReaderLength(FLEX_BUFFER *FlexBuffer, int Reader)
+{
+    FLEX_READER *Item = FLEX_FindReader(FlexBuffer, Reader);
+
+    if (!Item || FLEX_Atomic_Load(&Item->State) != FLEX_READER_ATTACHED)
+    {
+        return 0;
+    }
+
+    size_t RdIndex = FLEX_Atomic_Load(&Item->Cursor.Index);
+    size_t WrIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
+
+    return FLEX_Distance(FlexBuffer, RdIndex, WrIndex);
+}
+
+FLEX_RANGE *FLEX_GetWrRecord(FLEX_BUFFER *FlexBuffer, size_t Length, uint32_t Milliseconds)
+{
+    return FLEX_GetRecord(FlexBuffer, 0, Length, Milliseconds, NULL);
+}
+
+FLEX_RANGE *FLEX_GetRdRecord(FLEX_BUFFER *FlexBuffer, uint32_t Milliseconds)
+{
+    return FLEX_GetRecord(FlexBuffer, 1, 0, Milliseconds, NULL);
+}
+
+FLEX_RANGE *FLEX_GetRdPattern(FLEX_BUFFER *FlexBuffer, const uint8_t *Pattern, size_t Length, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Pattern || !Length || Length > FLEX_MAX_PATTERN)
+    {
+        return NULL;
+    }
+
+    /* Only bytes of the single consumer can be searched */
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        return NULL;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (!FLEX_Lock(FlexBuffer))
+        return NULL;
+
+    if (Cursor->Dequeued)
+    {
+        FLEX_Unlock(FlexBuffer);
+        return NULL;
+    }
+
+    /* A new pattern is searched from the beginning */
+    if (Length != Cursor->PatternLength || memcmp(Pattern, Cursor->Pattern, Length))
+    {
+        memcpy(Cursor->Pattern, Pattern, Length);
+
+        Cursor->PatternLength = Length;
+        Cursor->Scanned = 0;
+    }
+
+    /* Data may arrive several times before a match, so wait until a deadline */
+    uint64_t Time;
+
+    const uint64_t *Deadline = FLEX_Deadline(Milliseconds, &Time);
+
+    FLEX_RANGE *Range = NULL;
+
+    size_t Found = 0, Need = Cursor->Scanned + Length;
+
+    for (;;)
+    {
+        size_t Actual = FLEX_Wait(FlexBuffer, 1, Need, 0, Deadline);
+
+        /* Another thread may have dequeued while the mutex was released */
+        if (Actual < Need || Cursor->Dequeued)
+            break;
+
+        Found = FLEX_Scan(FlexBuffer, Cursor, Actual);
+
+        /* A full buffer without a match will not get one */
+        if (Found || Actual >= FlexBuffer->Size)
+            break;
+
+        Need = Actual + 1;
+    }
+
+    if (Found)
+    {
+        Range = FLEX_FillRange(FlexBuffer, Cursor->Range, Cursor->Index, Found);
+
+        /* Dequeued */
+        Cursor->Dequeued = true;
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Range;
+}
+
+bool FLEX_SetFrameFormat(FLEX_BUFFER *FlexBuffer, size_t Offset, size_t Width, bool BigEndian, int Adjust)
+{
+    if (!FlexBuffer)
+    {
+        return false;
+    }
+
+    if (Width != 1 && Width != 2 && Width != 4 && Width != 8)
+    {
+        return false;
+    }
+
+    /* The header must fit in the buffer */
+    if (Offset > FlexBuffer->Size || Offset + Width > FlexBuffer->Size)
+    {
+        return false;
+    }
+
+    if (!FLEX_Lock(FlexBuffer))
+        return false;
+
+    FlexBuffer->FrameOffset = Offset;
+    FlexBuffer->FrameWidth = Width;
+    FlexBuffer->FrameBigEndian = BigEndian;
+    FlexBuffer->FrameAdjust = Adjust;
+
+    FLEX_Unlock(FlexBuffer);
+
+    return true;
+}
+
+FLEX_RANGE *FLEX_GetRdFrame(FLEX_BUFFER *FlexBuffer, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !FlexBuffer->FrameWidth)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Only bytes of the single consumer can be decoded */
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (!FLEX_Lock(FlexBuffer))
+        return NULL;
+
+    if (Cursor->Dequeued)
+    {
+        FLEX_Unlock(FlexBuffer);
+        errno = EBUSY;
+        return NULL;
+    }
+
+    /* The header and the rest of the frame may arrive apart */
+    uint64_t Time;
+
+    const uint64_t *Deadline = FLEX_Deadline(Milliseconds, &Time);
+
+    FLEX_RANGE *Range = NULL;
+
+    size_t Length = FlexBuffer->FrameOffset + FlexBuffer->FrameWidth;
+    size_t Actual = FLEX_Wait(FlexBuffer, 1, Length, 0, Deadline);
+
+    /* Another thread may have dequeued while the mutex was released */
+    if (Actual >= Length && !Cursor->Dequeued)
+    {
+        Length = FLEX_FrameLength(FlexBuffer);
+
+        if (Length)
+        {
+            Actual = FLEX_Wait(FlexBuffer, 1, Length, 0, Deadline);
+        }
+
+        if (Length && Actual >= Length && !Cursor->Dequeued)
+        {
+            Range = FLEX_FillRange(FlexBuffer, Cursor->Range, Cursor->Index, Length);
+
+            /* Dequeued */
+            Cursor->Dequeued = true;
+        }
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    /* Tell a bad length field from a timeout, the header stays to be skipped */
+    if (!Range)
+        errno = Length ? ETIMEDOUT : EBADMSG;
+
+    return Range;
+}
+
+/* Read from Fd into free buffer, or write data to Fd, with one call over
+ * both parts of the ranges. Only the bytes transferred are put.
+ */
+static int64_t FLEX_Pump(FLEX_BUFFER *FlexBuffer, int Side, int Fd, size_t Length, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Length)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Ranges must be put partially, and hold bytes instead of records */
+    if (FlexBuffer->Slots || (FlexBuffer->Flags & FLEX_FLAG_RECORD) || (Side == 1 && FlexBuffer->Readers))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    FLEX_RANGE *Range = FLEX_GetBuffer(FlexBuffer, Side, Length, true, Milliseconds, NULL);
+
+    if (!Range)
+    {
+        /* Nothing to write is not an error */
+        if (Side == 1)
+            return 0;
+
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    uint8_t *Data[2];
+    size_t Size[2];
+    int Count = 0;
+
+    for (FLEX_RANGE *Part = Range; Part; Part = Part->Next)
+    {
+        Data[Count] = Part->Data;
+        Size[Count] = Part->Size;
+        Count++;
+    }
+
+    int64_t Ret = (Side == 0) ? FLEX_Fd_Read(Fd, Data, Size, Count) : FLEX_Fd_Write(Fd, Data, Size, Count);
+
+    if (Ret > 0)
+    {
+        if (Side == 0)
+            FLEX_PutWrBufferEx(FlexBuffer, Range, (size_t)Ret);
+        else
+            FLEX_PutRdBufferEx(FlexBuffer, Range, (size_t)Ret);
+    }
+    else
+    {
+        /* Keep errno of the failed call */
+        int Error = errno;
+
+        if (Side == 0)
+            FLEX_ReleaseWrBuffer(FlexBuffer);
+        else
+            FLEX_ReleaseRdBuffer(FlexBuffer);
+
+        errno = Error;
+    }
+
+    return Ret;
+}
+
+int64_t FLEX_ReadFd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds)
+{
+    return FLEX_Pump(FlexBuffer, 0, Fd, Length, Milliseconds);
+}
+
+int64_t FLEX_WriteFd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds)
+{
+    return FLEX_Pump(FlexBuffer, 1, Fd, Length, Milliseconds);
+}
+
+/* Copy between the ranges and caller memory, bypassing the cache for large copies */
+static void FLEX_CopyRange(FLEX_RANGE *Range, uint8_t *Data, size_t Length, bool Write)
+{
+    bool Stream = Length >= FLEX_STREAM_THRESHOLD;
+
+    for (FLEX_RANGE *Part = Range; Part; Part = Part->Next)
+    {
+        uint8_t *Dst = Write ? Part->Data : Data;
+        uint8_t *Src = Write ? Data : Part->Data;
+
+        if (Stream)
+            FLEX_Copy_Stream(Dst, Src, Part->Size);
+        else
+            memcpy(Dst, Src, Part->Size);
+
+        Data += Part->Size;
+    }
+}
+
+size_t FLEX_WriteBytes(FLEX_BUFFER *FlexBuffer, const void *Data, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    if (!Data)
+    {
+        return 0;
+    }
+
+    FLEX_RANGE *Range = FLEX_GetBuffer(FlexBuffer, 0, Length, Partial, Milliseconds, NULL);
+
+    if (!Range)
+    {
+        return 0;
+    }
+
+    size_t Actual = FLEX_RangeLength(Range);
+
+    FLEX_CopyRange(Range, (uint8_t *)Data, Actual, true);
+
+    FLEX_PutWrBuffer(FlexBuffer, Range);
+
+    return Actual;
+}
+
+size_t FLEX_ReadBytes(FLEX_BUFFER *FlexBuffer, void *Data, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    if (!Data)
+    {
+        return 0;
+    }
+
+    FLEX_RANGE *Range = FLEX_GetBuffer(FlexBuffer, 1, Length, Partial, Milliseconds, NULL);
+
+    if (!Range)
+    {
+        return 0;
+    }
+
+    size_t Actual = FLEX_RangeLength(Range);
+
+    FLEX_CopyRange(Range, (uint8_t *)Data, Actual, false);
+
+    FLEX_PutRdBuffer(FlexBuffer, Range);
+
+    return Actual;
+}
+
+size_t FLEX_PeekRdData(FLEX_BUFFER *FlexBuffer, size_t Offset, void *Data, size_t Length, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Data || !Length)
+    {
+        return 0;
+    }
+
+    /* Readers have their own cursors, and records are read as a whole */
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        return 0;
+    }
+
+    if (!FLEX_Lock(FlexBuffer))
+        return 0;
+
+    /* The size may change by FLEX_ResizeBuffer until locked */
+    if (Offset >= FlexBuffer->Size)
+    {
+        FLEX_Unlock(FlexBuffer);
+        return 0;
+    }
+
+    if (Length > FlexBuffer->Size - Offset)
+    {
+        Length = FlexBuffer->Size - Offset;
+    }
+
+    /* The cached write index usually covers the bytes, so the producer index is not read */
+    size_t Actual = FLEX_Wait(FlexBuffer, 1, Offset + Length, Milliseconds, NULL);
+
+    Actual = (Actual > Offset) ? Actual - Offset : 0;
+
+    if (Actual > Length)
+    {
+        Actual = Length;
+    }
+
+    if (Actual)
+    {
+        FLEX_CopyData(FlexBuffer, FLEX_Forward(FlexBuffer, FlexBuffer->Cursor[1].Index, Offset), (uint8_t *)Data, Actual);
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Actual;
+}
+
+size_t FLEX_SkipRdData(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Length)
+    {
+        return 0;
+    }
+
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        return 0;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (!FLEX_Lock(FlexBuffer))
+        return 0;
+
+    /* A range got or data held by transfers starts at the read index */
+    if (Cursor->Dequeued || Cursor->Held || Cursor->Transferring)
+    {
+        FLEX_Unlock(FlexBuffer);
+        return 0;
+    }
+
+    size_t Actual = FLEX_Wait(FlexBuffer, 1, Length, Milliseconds, NULL);
+
+    if (Actual > Length)
+    {
+        Actual = Length;
+    }
+
+    if (Actual < Length && !Partial)
+    {
+        Actual = 0;
+    }
+
+    /* Another thread may have dequeued while the mutex was released */
+    if (Cursor->Dequeued)
+    {
+        Actual = 0;
+    }
+
+    if (Actual)
+    {
+        FLEX_Consume(FlexBuffer, Actual);
+    }
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Actual;
+}
+
+/* Start or finish a transfer, or a completion. The consumer stays dequeued
+ * while data is held, so that only transfers and completions go on.
+ */
+static bool FLEX_BeginTransfer(FLEX_BUFFER *FlexBuffer)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    /* Ranges got by the consumer are put or released first */
+    if (Cursor->Transferring || (Cursor->Dequeued && !Cursor->Held))
+    {
+        return false;
+    }
+
+    Cursor->Transferring = true;
+    Cursor->Dequeued = true;
+
+    return true;
+}
+
+static void FLEX_EndTransfer(FLEX_BUFFER *FlexBuffer)
+{
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    Cursor->Transferring = false;
+    Cursor->Dequeued = (Cursor->Held != 0);
+}
+
+/* Splice or send data to read after the held data, and hold it too */
+static int64_t FLEX_Transfer(FLEX_BUFFER *FlexBuffer, int Fd, bool ZeroCopy, size_t Length, uint32_t Milliseconds)
+{
+    if (!FlexBuffer || !Length)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (FlexBuffer->Readers || (FlexBuffer->Flags & FLEX_FLAG_RECORD))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (!FLEX_Lock(FlexBuffer))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!FLEX_BeginTransfer(FlexBuffer))
+    {
+        FLEX_Unlock(FlexBuffer);
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (FlexBuffer->TransferCount == FLEX_MAX_TRANSFERS)
+    {
+        FLEX_EndTransfer(FlexBuffer);
+        FLEX_Unlock(FlexBuffer);
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    /* Send numbers are counted per socket */
+    if (ZeroCopy && Fd != FlexBuffer->ZeroCopyFd)
+    {
+        size_t i;
+
+        for (i = 0; i < FlexBuffer->TransferCount; i++)
+        {
+            if (FlexBuffer->Transfers[(FlexBuffer->TransferHead + i) % FLEX_MAX_TRANSFERS].ZeroCopy)
+                break;
+        }
+
+        if (i < FlexBuffer->TransferCount)
+        {
+            FLEX_EndTransfer(FlexBuffer);
+            FLEX_Unlock(FlexBuffer);
+            errno = EBUSY;
+            return -1;
+        }
+
+        FlexBuffer->ZeroCopyFd = Fd;
+        FlexBuffer->ZeroCopyId = 0;
+    }
+
+    /* Nobody else moves the read index while transferring */
+    size_t Actual = FLEX_Wait(FlexBuffer, 1, Cursor->Held + Length, Milliseconds, NULL);
+
+    if (Actual <= Cursor->Held)
+    {
+        FLEX_EndTransfer(FlexBuffer);
+        FLEX_Unlock(FlexBuffer);
+        return 0;
+    }
+
+    Actual -= Cursor->Held;
+
+    if (Actual > Length)
     {
         Actual = Length;
     }
 
-    if (Actual < Length && !Partial)
+    FLEX_RANGE *Range = FLEX_FillRange(FlexBuffer, Cursor->Range, FLEX_Forward(FlexBuffer, Cursor->Index, Cursor->Held), Actual);
+
+    FLEX_Unlock(FlexBuffer);
+
+    uint8_t *Data[2];
+    size_t Size[2];
+    int Count = 0;
+
+    for (FLEX_RANGE *Part = Range; Part; Part = Part->Next)
+    {
+        Data[Count] = Part->Data;
+        Size[Count] = Part->Size;
+        Count++;
+    }
+
+    int64_t Ret = ZeroCopy ? FLEX_Fd_SendZeroCopy(Fd, Data, Size, Count) : FLEX_Fd_Splice(Fd, Data, Size, Count);
+
+    /* Keep errno of the failed call */
+    int Error = errno;
+
+    /* The mutex was locked before, and Transferring is still set */
+    FLEX_Lock(FlexBuffer);
+
+    if (Ret > 0)
+    {
+        FLEX_TRANSFER *Transfer = &FlexBuffer->Transfers[(FlexBuffer->TransferHead + FlexBuffer->TransferCount) % FLEX_MAX_TRANSFERS];
+
+        Transfer->Fd = Fd;
+        Transfer->Id = ZeroCopy ? FlexBuffer->ZeroCopyId++ : 0;
+        Transfer->Length = (size_t)Ret;
+        Transfer->ZeroCopy = ZeroCopy;
+        Transfer->Done = false;
+
+        FlexBuffer->TransferCount++;
+
+        Cursor->Held += (size_t)Ret;
+    }
+
+    FLEX_EndTransfer(FlexBuffer);
+    FLEX_Unlock(FlexBuffer);
+
+    errno = Error;
+    return Ret;
+}
+
+int64_t FLEX_SpliceRd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds)
+{
+    return FLEX_Transfer(FlexBuffer, Fd, false, Length, Milliseconds);
+}
+
+int64_t FLEX_SendZeroCopy(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds)
+{
+    return FLEX_Transfer(FlexBuffer, Fd, true, Length, Milliseconds);
+}
+
+int64_t FLEX_CompleteRd(FLEX_BUFFER *FlexBuffer, int Fd)
+{
+    size_t i;
+
+    if (!FlexBuffer)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    FLEX_CURSOR *Cursor = &FlexBuffer->Cursor[1];
+
+    if (!FLEX_Lock(FlexBuffer))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* A transfer in progress may not be numbered yet */
+    if (!FLEX_BeginTransfer(FlexBuffer))
+    {
+        FLEX_Unlock(FlexBuffer);
+        errno = EBUSY;
+        return -1;
+    }
+
+    size_t Spliced = 0;
+    bool Sent = false;
+
+    for (i = 0; i < FlexBuffer->TransferCount; i++)
+    {
+        FLEX_TRANSFER *Transfer = &FlexBuffer->Transfers[(FlexBuffer->TransferHead + i) % FLEX_MAX_TRANSFERS];
+
+        if (Transfer->Fd != Fd || Transfer->Done)
+            continue;
+
+        if (Transfer->ZeroCopy)
+            Sent = true;
+        else
+            Spliced += Transfer->Length;
+    }
+
+    /* Calls below do not wait, so the mutex is kept */
+    int Ret = 0;
+
+    if (Spliced)
+    {
+        size_t Unread;
+
+        Ret = FLEX_Fd_Unread(Fd, &Unread);
+
+        /* Spliced bytes still in the pipe, the rest has been read */
+        size_t Read = (Ret == 0 && Unread < Spliced) ? Spliced - Unread : 0;
+
+        for (i = 0; i < FlexBuffer->TransferCount && Read; i++)
+        {
+            FLEX_TRANSFER *Transfer = &FlexBuffer->Transfers[(FlexBuffer->TransferHead + i) % FLEX_MAX_TRANSFERS];
+
+            if (Transfer->Fd != Fd || Transfer->ZeroCopy || Transfer->Done)
+                continue;
+
+            /* Partly read data is still referred to */
+            if (Transfer->Length > Read)
+                break;
+
+            Read -= Transfer->Length;
+            Transfer->Done = true;
+        }
+    }
+
+    while (Sent && Ret == 0)
+    {
+        uint32_t Lo, Hi;
+
+        int Got = FLEX_Fd_ZeroCopyDone(Fd, &Lo, &Hi);
+
+        if (Got <= 0)
+        {
+            Ret = Got;
+            break;
+        }
+
+        for (i = 0; i < FlexBuffer->TransferCount; i++)
+        {
+            FLEX_TRANSFER *Transfer = &FlexBuffer->Transfers[(FlexBuffer->TransferHead + i) % FLEX_MAX_TRANSFERS];
+
+            /* Numbers wrap around, Lo to Hi inclusive */
+            if (Transfer->ZeroCopy && Transfer->Fd == Fd && (uint32_t)(Transfer->Id - Lo) <= (uint32_t)(Hi - Lo))
+                Transfer->Done = true;
+        }
+    }
+
+    /* Keep errno of the failed call */
+    int Error = errno;
+
+    /* Put back completed data in transfer order */
+    size_t Length = 0;
+
+    while (FlexBuffer->TransferCount && FlexBuffer->Transfers[FlexBuffer->TransferHead].Done)
+    {
+        Length += FlexBuffer->Transfers[FlexBuffer->TransferHead].Length;
+
+        FlexBuffer->TransferHead = (FlexBuffer->TransferHead + 1) % FLEX_MAX_TRANSFERS;
+        FlexBuffer->TransferCount--;
+    }
+
+    if (Length)
+    {
+        Cursor->Held -= Length;
+
+        FLEX_Consume(FlexBuffer, Length);
+    }
+
+    FLEX_EndTransfer(FlexBuffer);
+    FLEX_Unlock(FlexBuffer);
+
+    if (Ret < 0)
+    {
+        errno = Error;
+        return -1;
+    }
+
+    return (int64_t)Length;
+}
+
+FLEX_ENGINE *FLEX_CreateEngine(uint32_t Depth)
+{
+    int i;
+
+    if (!Depth)
+    {
+        return NULL;
+    }
+
+    FLEX_ENGINE *Engine = (FLEX_ENGINE *)malloc(sizeof(FLEX_ENGINE));
+
+    if (!Engine)
+    {
+        return NULL;
+    }
+
+    memset(Engine, 0, sizeof(FLEX_ENGINE));
+
+    Engine->Depth = Depth;
+
+    for (i = 0; i < FLEX_MAX_STREAMS; i++)
+    {
+        Engine->Streams[i].Fixed = -1;
+    }
+
+    /* Cancellations take entries too. Without io_uring, Fd stays -1. */
+    FLEX_Uring_Create(&Engine->Uring, Depth + FLEX_MAX_STREAMS, FLEX_MAX_STREAMS);
+
+    return Engine;
+}
+
+/* Free the slot of a removed stream */
+static void FLEX_ClearStream(FLEX_ENGINE *Engine, FLEX_STREAM *Stream)
+{
+    FLEX_BUFFER *FlexBuffer = Stream->FlexBuffer;
+
+    if (Stream->Fixed >= 0)
+    {
+        FLEX_Uring_Register(&Engine->Uring, (uint32_t)Stream->Fixed, NULL, 0);
+    }
+
+    if (FLEX_Lock(FlexBuffer))
+    {
+        FlexBuffer->Engaged--;
+
+        FLEX_Unlock(FlexBuffer);
+    }
+
+    memset(Stream, 0, sizeof(FLEX_STREAM));
+
+    Stream->Fixed = -1;
+}
+
+/* Put or release the ranges of a completed operation */
+static void FLEX_FinishStream(FLEX_ENGINE *Engine, FLEX_STREAM *Stream, int32_t Result)
+{
+    FLEX_BUFFER *FlexBuffer = Stream->FlexBuffer;
+
+    if (Result > 0)
+    {
+        if (Stream->Side == 0)
+            FLEX_PutWrBufferEx(FlexBuffer, Stream->Range, (size_t)Result);
+        else
+            FLEX_PutRdBufferEx(FlexBuffer, Stream->Range, (size_t)Result);
+
+        Stream->Bytes += (uint64_t)Result;
+    }
+    else
+    {
+        if (Stream->Side == 0)
+            FLEX_ReleaseWrBuffer(FlexBuffer);
+        else
+            FLEX_ReleaseRdBuffer(FlexBuffer);
+
+        /* Not ready or interrupted operations are started again */
+        if (Result == 0 && Stream->Side == 0)
+            Stream->Status = FLEX_STREAM_EOF;
+        else if (Result < 0 && Result != -EAGAIN && Result != -EINTR && Result != -ECANCELED)
+            Stream->Status = Result;
+    }
+
+    Stream->Range = NULL;
+
+    if (Stream->Removing)
+    {
+        FLEX_ClearStream(Engine, Stream);
+    }
+}
+
+void FLEX_DeleteEngine(FLEX_ENGINE *Engine)
+{
+    int i;
+
+    if (!Engine)
+    {
+        return;
+    }
+
+    if (Engine->Uring.Fd >= 0)
+    {
+        for (i = 0; i < FLEX_MAX_STREAMS; i++)
+        {
+            FLEX_STREAM *Stream = &Engine->Streams[i];
+
+            if (Stream->Range)
+            {
+                Stream->Removing = true;
+                FLEX_Uring_Cancel(&Engine->Uring, (uint64_t)i + 1, FLEX_ENGINE_CANCEL);
+            }
+        }
+
+        /* The kernel writes to the buffers until operations complete */
+        while (Engine->InFlight)
+        {
+            uint64_t UserData;
+            int32_t Result;
+
+            if (FLEX_Uring_Submit(&Engine->Uring, 1, FLEX_INFINITE))
+                break;
+
+            while (FLEX_Uring_Reap(&Engine->Uring, &UserData, &Result))
+            {
+                if (UserData == FLEX_ENGINE_CANCEL)
+                    continue;
+
+                FLEX_FinishStream(Engine, &Engine->Streams[UserData - 1], Result);
+
+                Engine->InFlight--;
+            }
+        }
+
+        FLEX_Uring_Delete(&Engine->Uring);
+    }
+
+    for (i = 0; i < FLEX_MAX_STREAMS; i++)
+    {
+        if (Engine->Streams[i].FlexBuffer)
+            FLEX_ClearStream(Engine, &Engine->Streams[i]);
+    }
+
+    free(Engine);
+}
+
+uint32_t FLEX_GetEngineFlags(FLEX_ENGINE *Engine)
+{
+    uint32_t Flags = 0;
+
+    if (Engine && Engine->Uring.Fd >= 0)
+    {
+        Flags |= FLEX_ENGINE_URING;
+
+        if (Engine->Uring.Fixed)
+            Flags |= FLEX_ENGINE_FIXED;
+    }
+
+    return Flags;
+}
+
+int FLEX_AddEngineStream(FLEX_ENGINE *Engine, FLEX_BUFFER *FlexBuffer, int Fd, bool Write, size_t Length)
+{
+    int i;
+
+    if (!Engine || !FlexBuffer || !Length)
+    {
+        return -1;
+    }
+
+    /* Operations put partially, and bytes instead of records */
+    if (FlexBuffer->Slots || (FlexBuffer->Flags & FLEX_FLAG_RECORD) || (Write && FlexBuffer->Readers))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < FLEX_MAX_STREAMS; i++)
+    {
+        if (!Engine->Streams[i].FlexBuffer)
+            break;
+    }
+
+    if (i == FLEX_MAX_STREAMS)
+    {
+        return -1;
+    }
+
+    FLEX_STREAM *Stream = &Engine->Streams[i];
+
+    /* Registered data must not be replaced by FLEX_ResizeBuffer */
+    if (!FLEX_Lock(FlexBuffer))
+    {
+        return -1;
+    }
+
+    FlexBuffer->Engaged++;
+
+    FLEX_Unlock(FlexBuffer);
+
+    Stream->FlexBuffer = FlexBuffer;
+    Stream->Fd = Fd;
+    Stream->Side = Write ? 1 : 0;
+    Stream->Length = Length;
+    Stream->Status = FLEX_STREAM_ACTIVE;
+    Stream->Bytes = 0;
+
+    /* Ranges of mirrored memory run into the second mapping */
+    size_t Size = (FlexBuffer->Flags & FLEX_FLAG_MIRROR) ? 2 * FlexBuffer->Size : FlexBuffer->Size;
+
+    /* Fixed buffers pin pages, released pages would be replaced behind them */
+    if (Engine->Uring.Fixed && !(FlexBuffer->Flags & FLEX_FLAG_ELASTIC) && FLEX_Uring_Register(&Engine->Uring, (uint32_t)i, FlexBuffer->Data, Size) == 0)
+    {
+        Stream->Fixed = i;
+    }
+
+    return i;
+}
+
+bool FLEX_RemoveEngineStream(FLEX_ENGINE *Engine, int Stream)
+{
+    if (!Engine || Stream < 0 || Stream >= FLEX_MAX_STREAMS)
+    {
+        return false;
+    }
+
+    FLEX_STREAM *Entry = &Engine->Streams[Stream];
+
+    if (!Entry->FlexBuffer || Entry->Removing)
+    {
+        return false;
+    }
+
+    Entry->Removing = true;
+
+    /* Freed by FLEX_RunEngine when the cancellation completes */
+    if (Entry->Range)
+    {
+        return FLEX_Uring_Cancel(&Engine->Uring, (uint64_t)Stream + 1, FLEX_ENGINE_CANCEL);
+    }
+
+    FLEX_ClearStream(Engine, Entry);
+
+    return true;
+}
+
+int FLEX_GetEngineStream(FLEX_ENGINE *Engine, int Stream, uint64_t *Bytes)
+{
+    if (!Engine || Stream < 0 || Stream >= FLEX_MAX_STREAMS || !Engine->Streams[Stream].FlexBuffer)
+    {
+        return -EINVAL;
+    }
+
+    if (Bytes)
+    {
+        *Bytes = Engine->Streams[Stream].Bytes;
+    }
+
+    return Engine->Streams[Stream].Status;
+}
+
+/* One pass of non-blocking readv/writev, without io_uring */
+static int FLEX_PumpEngine(FLEX_ENGINE *Engine)
+{
+    int i, Done = 0;
+
+    for (i = 0; i < FLEX_MAX_STREAMS; i++)
+    {
+        FLEX_STREAM *Stream = &Engine->Streams[i];
+
+        if (!Stream->FlexBuffer || Stream->Status != FLEX_STREAM_ACTIVE)
+            continue;
+
+        int64_t Ret = FLEX_Pump(Stream->FlexBuffer, Stream->Side, Stream->Fd, Stream->Length, 0);
+
+        if (Ret > 0)
+        {
+            Stream->Bytes += (uint64_t)Ret;
+            Done++;
+        }
+        else if (Ret == 0 && Stream->Side == 0)
+            Stream->Status = FLEX_STREAM_EOF;
+        else if (Ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+            Stream->Status = -errno;
+    }
+
+    return Done;
+}
+
+int FLEX_RunEngine(FLEX_ENGINE *Engine, uint32_t Milliseconds)
+{
+    int i, Done = 0;
+
+    if (!Engine)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (Engine->Uring.Fd < 0)
+    {
+        Done = FLEX_PumpEngine(Engine);
+
+        if (Done || !Milliseconds)
+            return Done;
+
+        /* Wait for descriptors of streams that have free buffer or data */
+        int Fd[FLEX_MAX_STREAMS];
+        bool Write[FLEX_MAX_STREAMS];
+        int Count = 0;
+
+        for (i = 0; i < FLEX_MAX_STREAMS; i++)
+        {
+            FLEX_STREAM *Stream = &Engine->Streams[i];
+
+            if (!Stream->FlexBuffer || Stream->Status != FLEX_STREAM_ACTIVE)
+                continue;
+
+            if (Stream->Side == 0 ? !FLEX_PeekWrLength(Stream->FlexBuffer) : !FLEX_PeekRdLength(Stream->FlexBuffer))
+                continue;
+
+            Fd[Count] = Stream->Fd;
+            Write[Count] = (Stream->Side == 1);
+            Count++;
+        }
+
+        if (!Count)
+            return 0;
+
+        if (FLEX_Fd_Poll(Fd, Write, Count, Milliseconds) < 0)
+            return (errno == EINTR) ? 0 : -1;
+
+        return FLEX_PumpEngine(Engine);
+    }
+
+    /* Start an operation for each idle stream, within the depth */
+    for (i = 0; i < FLEX_MAX_STREAMS && Engine->InFlight < Engine->Depth; i++)
+    {
+        FLEX_STREAM *Stream = &Engine->Streams[i];
+
+        if (!Stream->FlexBuffer || Stream->Removing || Stream->Range || Stream->Status != FLEX_STREAM_ACTIVE)
+            continue;
+
+        FLEX_RANGE *Range = FLEX_GetBuffer(Stream->FlexBuffer, Stream->Side, Stream->Length, true, 0, NULL);
+
+        if (!Range)
+            continue;
+
+        uint8_t *Data[FLEX_URING_PARTS];
+        size_t Size[FLEX_URING_PARTS];
+        int Count = 0;
+
+        /* Both parts of a wrapped range go in one vectored operation */
+        for (FLEX_RANGE *Part = Range; Part; Part = Part->Next)
+        {
+            Data[Count] = Part->Data;
+            Size[Count] = Part->Size;
+            Count++;
+        }
+
+        if (!FLEX_Uring_Prepare(&Engine->Uring, Stream->Side ? FLEX_URING_WRITE : FLEX_URING_READ, Stream->Fd,
+            Data, Size, Count, Stream->Fixed, (uint64_t)i + 1))
+        {
+            if (Stream->Side == 0)
+                FLEX_ReleaseWrBuffer(Stream->FlexBuffer);
+            else
+                FLEX_ReleaseRdBuffer(Stream->FlexBuffer);
+
+            break;
+        }
+
+        Stream->Range = Range;
+        Engine->InFlight++;
+    }
+
+    int Ret = FLEX_Uring_Submit(&Engine->Uring, Engine->InFlight ? 1 : 0, Milliseconds);
+
+    if (Ret)
     {
-        Actual = 0;
+        errno = Ret;
+        return -1;
     }
 
-    if (Actual)
+    uint64_t UserData;
+    int32_t Result;
+
+    while (FLEX_Uring_Reap(&Engine->Uring, &UserData, &Result))
     {
-        /* Fill in range fields and return 
-         * no allocation required 
-         */
-        Range = &FlexBuffer->Range[0][0];
+        if (UserData == FLEX_ENGINE_CANCEL)
+            continue;
 
-        FlexBuffer->Range[0][0].Data = &FlexBuffer->Data[FlexBuffer->Position];
+        FLEX_FinishStream(Engine, &Engine->Streams[UserData - 1], Result);
 
-        if (FlexBuffer->Position + Actual <= FlexBuffer->Size)
-        {
-            FlexBuffer->Range[0][0].Size = Actual;
-            FlexBuffer->Range[0][0].Next = NULL;
-        }
-        else
-        {
-            FlexBuffer->Range[0][0].Size = FlexBuffer->Size - FlexBuffer->Position;
-            FlexBuffer->Range[0][0].Next = &FlexBuffer->Range[0][1];
+        Engine->InFlight--;
+        Done++;
+    }
 
-            /* Wrap-around */
-            FlexBuffer->Range[0][1].Data = &FlexBuffer->Data[0];
-            FlexBuffer->Range[0][1].Size = FlexBuffer->Position + Actual - FlexBuffer->Size;
-            FlexBuffer->Range[0][1].Next = NULL;
-        }
+    return Done;
+}
 
-        /* Dequeued */
-        FlexBuffer->Dequeued[0] = true;
+uint64_t FLEX_GetTime(void)
+{
+    return FLEX_Clock_Now();
+}
+
+int FLEX_GetWrEventFd(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+    {
+        return -1;
     }
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    return FLEX_Event_GetFd(&FlexBuffer->Event[0]);
+}
 
-    return Range;
+int FLEX_GetRdEventFd(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+    {
+        return -1;
+    }
+
+    return FLEX_Event_GetFd(&FlexBuffer->Event[1]);
 }
 
-FLEX_RANGE *FLEX_GetRdBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds)
+bool FLEX_PeekWakeCount(FLEX_BUFFER *FlexBuffer, size_t *Signaled, size_t *Elided)
 {
-    if (!FlexBuffer || !Length)
+    if (!FlexBuffer || !Signaled || !Elided)
     {
-        return NULL;
+        return false;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    /* Snapshot only, the counters are owned by each side */
+    *Signaled = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Signaled) + FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Signaled);
+    *Elided   = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Elided) + FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Elided);
 
-    if (Ret)
-        return NULL;
+    return true;
+}
 
-    if (FlexBuffer->Dequeued[1])
+bool FLEX_SetWaitPolicy(FLEX_BUFFER *FlexBuffer, uint32_t SpinCount, uint32_t YieldCount)
+{
+    if (!FlexBuffer)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
-        return NULL;
+        return false;
     }
 
-#ifdef _WIN32
-    FILETIME FileTime;
+    FlexBuffer->SpinCount = SpinCount;
+    FlexBuffer->YieldCount = YieldCount;
 
-    GetSystemTimeAsFileTime(&FileTime);
-#else
-    struct timespec Ts;
+    return true;
+}
 
-    Ret = clock_gettime(CLOCK_REALTIME, &Ts);
+bool FLEX_SetReserveDepth(FLEX_BUFFER *FlexBuffer, size_t Depth)
+{
+    if (!FlexBuffer || !FlexBuffer->Slots)
+    {
+        return false;
+    }
 
-    if (Ret)
+    if (!Depth || Depth > FLEX_SLOTS)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
-        return NULL;
+        return false;
     }
-#endif
 
-#ifdef _WIN32
-    uint64_t Time = (uint64_t)FileTime.dwLowDateTime + (((uint64_t)FileTime.dwHighDateTime) << 32);
+    FlexBuffer->Depth = Depth;
+
+    return true;
+}
+
+size_t FLEX_PeekWrLength(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+        return 0;
+
+    if (!FLEX_Lock(FlexBuffer))
+        return 0;
 
-    /* FILETIME has a precision of 100-nano seconds */
-    Time /= 10000ULL;
+    size_t RdIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+    size_t WrIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
 
-    if (Milliseconds != FLEX_INFINITE)
+    /* Reserved buffer is not free any more */
+    if (FlexBuffer->Slots)
     {
-        Time += Milliseconds;
+        WrIndex = (size_t)(FLEX_Atomic_Load64(&FlexBuffer->Reserve) & FLEX_INDEX_MASK);
     }
-#else
-    if (Milliseconds != FLEX_INFINITE)
-    {
-        uint64_t Nano = Ts.tv_nsec + Milliseconds * 1000000ULL;
 
-        Ts.tv_sec += Nano / 1000000000ULL;
-        Ts.tv_nsec = Nano % 1000000000ULL;
+    size_t Length = FLEX_Distance(FlexBuffer, RdIndex, WrIndex);
+
+    /* Lock-free sides move on between the two loads, see FLEX_PeekRdLength */
+    if (Length > FlexBuffer->Size)
+        Length = FlexBuffer->Size;
+
+    Length = FlexBuffer->Size - Length;
+
+    FLEX_Unlock(FlexBuffer);
+
+    return Length;
 }
-#endif
 
-    FLEX_RANGE *Range = NULL;
+size_t FLEX_PeekRdLength(FLEX_BUFFER *FlexBuffer)
+{
+    if (!FlexBuffer)
+        return 0;
 
-    int Result = 0;
+    if (!FLEX_Lock(FlexBuffer))
+        return 0;
 
-    while (FlexBuffer->Size - FlexBuffer->Length < Length && Result == 0)
-    {
-#ifdef _WIN32
-        uint32_t Timeout = Milliseconds;
+    size_t RdIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[1].Index);
+    size_t WrIndex = FLEX_Atomic_Load(&FlexBuffer->Cursor[0].Index);
 
-        if (Milliseconds != FLEX_INFINITE)
-        {
-            GetSystemTimeAsFileTime(&FileTime);
+    size_t Length = FLEX_Distance(FlexBuffer, RdIndex, WrIndex);
 
-            uint64_t Now = (uint64_t)FileTime.dwLowDateTime + (((uint64_t)FileTime.dwHighDateTime) << 32);
+    /* In lock-free mode the mutex is not taken, and a thread other than
+     * the producer and the consumer may load the read index before the
+     * consumer moves it and the write index after the producer fills
+     * the room, more than Size bytes apart
+     */
+    if (Length > FlexBuffer->Size)
+        Length = FlexBuffer->Size;
 
-            /* FILETIME has a precision of 100-nano seconds */
-            Now /= 10000ULL;
+    FLEX_Unlock(FlexBuffer);
 
-            if (Now < Time)
-            {
-                /* Prevent from infinite wait if (Time - Now == INFINITE),
-                 * which is probably possible on a multi-core CPU system. 
-                 */
-                Timeout = (uint32_t)min(Time - Now, FLEX_INFINITE - 1);
-            }
-            else
-                Timeout = 0; /* Time in the past */
-        }
+    return Length;
+}
 
-        Ret = FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+bool FLEX_ResizeBuffer(FLEX_BUFFER *FlexBuffer, size_t Size)
+{
+    if (!FlexBuffer || !Size || Size > SIZE_MAX / 2)
+    {
+        return false;
+    }
 
-        if (Ret)
-            break;
+    /* Lock-free sides never wait for the mutex, and file or record
+     * contents are laid out for the current size
+     */
+    if (FlexBuffer->Flags & (FLEX_FLAG_LOCKFREE | FLEX_FLAG_RECORD))
+    {
+        return false;
+    }
 
-        Result = FLEX_Event_Wait(&FlexBuffer->Event[1], Timeout);
+    if (FlexBuffer->Header)
+    {
+        return false;
+    }
 
-        Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
+    if (FlexBuffer->Flags & FLEX_FLAG_MIRROR)
+    {
+        size_t PageSize = FLEX_Page_Size();
 
-        if (Ret)
-        {
-            /* This should never happen in practice */
-            return NULL;
-        }
-#else
-        if (Milliseconds != FLEX_INFINITE)
+        if (Size > SIZE_MAX / 2 - PageSize)
         {
-            Result = pthread_cond_timedwait(&FlexBuffer->Event[1], &FlexBuffer->Mutex, &Ts);
+            return false;
         }
-        else
-            Result = pthread_cond_wait(&FlexBuffer->Event[1], &FlexBuffer->Mutex);
-#endif
+
+        Size = (Size + PageSize - 1) / PageSize * PageSize;
     }
 
-    size_t Actual = FlexBuffer->Size - FlexBuffer->Length;
+    /* The new data is allocated without blocking the sides */
+    FLEX_BUFFER *Fresh = (FLEX_BUFFER *)FLEX_Aligned_Malloc(sizeof(FLEX_BUFFER), FLEX_CACHE_LINE);
 
-    if (Actual > Length)
+    if (!Fresh)
     {
-        Actual = Length;
+        return false;
     }
 
-    if (Actual < Length && !Partial)
+    memset(Fresh, 0, sizeof(FLEX_BUFFER));
+
+    Fresh->Size = Size;
+    Fresh->Alignment = FlexBuffer->Alignment;
+    Fresh->Flags = FlexBuffer->Flags;
+
+    FLEX_AllocData(Fresh);
+
+    if (!Fresh->Data)
     {
-        Actual = 0;
+        FLEX_Aligned_Free(Fresh);
+        return false;
     }
 
-    if (Actual)
+    if (!FLEX_Lock(FlexBuffer))
     {
-        /* Fill in range fields and return 
-         * no allocation required 
-         */
-        Range = &FlexBuffer->Range[1][0];
-
-        size_t Position = FlexBuffer->Position + FlexBuffer->Length;
+        FLEX_FreeData(Fresh, Fresh->Data, Fresh->Size, Fresh->PagesSize);
+        FLEX_Aligned_Free(Fresh);
+        return false;
+    }
 
-        /* Wrap-around */
-        if (Position >= FlexBuffer->Size)
-            Position -= FlexBuffer->Size;
+    FLEX_CURSOR *Cursor = FlexBuffer->Cursor;
 
-        FlexBuffer->Range[1][0].Data = &FlexBuffer->Data[Position];
+    size_t WrIndex = Cursor[0].Index;
+    size_t RdIndex = Cursor[1].Index;
 
-        if (Position + Actual <= FlexBuffer->Size)
-        {
-            FlexBuffer->Range[1][0].Size = Actual;
-            FlexBuffer->Range[1][0].Next = NULL;
-        }
-        else
-        {
-            FlexBuffer->Range[1][0].Size = FlexBuffer->Size - Position;
-            FlexBuffer->Range[1][0].Next = &FlexBuffer->Range[1][1];
+    size_t Length = FLEX_Distance(FlexBuffer, RdIndex, WrIndex);
+    size_t Reserved = Cursor[0].Dequeued ? FLEX_RangeLength(Cursor[0].Range) : 0;
 
-            /* Wrap-around */
-            FlexBuffer->Range[1][1].Data = &FlexBuffer->Data[0];
-            FlexBuffer->Range[1][1].Size = Position + Actual - FlexBuffer->Size;
-            FlexBuffer->Range[1][1].Next = NULL;
-        }
+    /* Transfers and engine streams point into the current data, and the
+     * data of the last resize is still in use
+     */
+    if (Cursor[1].Held || Cursor[1].Transferring || FlexBuffer->TransferCount || FlexBuffer->Engaged ||
+        FlexBuffer->OldData || Length + Reserved > Size)
+    {
+        FLEX_Unlock(FlexBuffer);
 
-        /* Dequeued */
-        FlexBuffer->Dequeued[1] = true;
+        FLEX_FreeData(Fresh, Fresh->Data, Fresh->Size, Fresh->PagesSize);
+        FLEX_Aligned_Free(Fresh);
+        return false;
     }
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    /* Buffered data moves to the start of the new data */
+    FLEX_CopyData(FlexBuffer, RdIndex, Fresh->Data, Length);
 
-    return Range;
-}
+    uint8_t *Data = FlexBuffer->Data;
+    size_t OldSize = FlexBuffer->Size;
+    size_t PagesSize = FlexBuffer->PagesSize;
 
-size_t FLEX_PeekWrLength(FLEX_BUFFER *FlexBuffer)
-{
-    if (!FlexBuffer)
-        return 0;
+    FlexBuffer->Data = Fresh->Data;
+    FlexBuffer->Size = Size;
+    FlexBuffer->PagesSize = Fresh->PagesSize;
+    FlexBuffer->HugeTlb = Fresh->HugeTlb;
+    FlexBuffer->Flags = Fresh->Flags;
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    /* Ranges got before stay valid until they are put or released */
+    FlexBuffer->Stale[0] = Cursor[0].Dequeued;
+    FlexBuffer->Stale[1] = Cursor[1].Dequeued;
 
-    if (Ret)
-        return 0;
+    bool Keep = FlexBuffer->Stale[0] || FlexBuffer->Stale[1];
 
-    size_t Length = FlexBuffer->Length;
+    if (Keep)
+    {
+        FlexBuffer->OldData = Data;
+        FlexBuffer->OldSize = OldSize;
+        FlexBuffer->OldPagesSize = PagesSize;
+    }
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    FLEX_Atomic_Store(&Cursor[0].Index, Length);
+    FLEX_Atomic_Store(&Cursor[1].Index, 0);
 
-    return Length;
-}
+    Cursor[0].Cached = 0;
+    Cursor[1].Cached = Length;
 
-size_t FLEX_PeekRdLength(FLEX_BUFFER *FlexBuffer)
-{
-    if (!FlexBuffer)
-        return 0;
+    FlexBuffer->TrimTime = 0;
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    /* Either side may have room now */
+    FLEX_Wake(FlexBuffer, 0);
+    FLEX_Wake(FlexBuffer, 1);
 
-    if (Ret)
-        return 0;
+    FLEX_Unlock(FlexBuffer);
 
-    size_t Length = FlexBuffer->Size - FlexBuffer->Length;
+    if (!Keep)
+    {
+        FLEX_FreeData(Fresh, Data, OldSize, PagesSize);
+    }
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    FLEX_Aligned_Free(Fresh);
 
-    return Length;
+    return true;
 }
 
 bool FLEX_PutWrBuffer(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range)
 {
-    if (!FlexBuffer || !Range)
+    if (!Range)
     {
         return false;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    return FLEX_PutWrBufferEx(FlexBuffer, Range, FLEX_RangeLength(Range));
+}
 
-    if (Ret)
+bool FLEX_PutRdBuffer(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range)
+{
+    if (!Range)
+    {
         return false;
+    }
 
-    if (!FlexBuffer->Dequeued[0])
+    return FLEX_PutRdBufferEx(FlexBuffer, Range, FLEX_RangeLength(Range));
+}
+
+bool FLEX_PutWrBufferEx(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Length)
+{
+    if (!FlexBuffer || !Range || Length > FLEX_RangeLength(Range))
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
         return false;
     }
 
-    size_t Length = Range->Size;
+    if (FlexBuffer->Slots)
+    {
+        return FLEX_Commit(FlexBuffer, Range, Length);
+    }
+
+    if (!FLEX_Lock(FlexBuffer))
+        return false;
 
-    if (Range->Next)
+    if (!FlexBuffer->Cursor[0].Dequeued)
     {
-        Length += Range->Next->Size;
+        FLEX_Unlock(FlexBuffer);
+        return false;
     }
 
-    if (Length > FlexBuffer->Length)
+    if (FLEX_RangeLength(Range) > FLEX_WrLength(FlexBuffer, FLEX_RangeLength(Range)))
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        FLEX_Unlock(FlexBuffer);
         return false;
     }
-    
-    FlexBuffer->Position += Length;
-    FlexBuffer->Length   -= Length;
 
-    /* Wrap-around */
-    if (FlexBuffer->Position >= FlexBuffer->Size)
-        FlexBuffer->Position -= FlexBuffer->Size;
+    FlexBuffer->Cursor[0].Dequeued = false;
+
+    /* Write the header and take alignment along, padding was put by FLEX_GetRecord */
+    if ((FlexBuffer->Flags & FLEX_FLAG_RECORD) && Length)
+    {
+        FLEX_RECORD Record;
 
-    FlexBuffer->Dequeued[0] = false;
+        Record.Length = (uint32_t)Length;
+        Record.Padding = 0;
 
-    FLEX_Event_Signal(&FlexBuffer->Event[1]);
-    
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        size_t Position = FlexBuffer->Cursor[0].Index;
+
+        if (Position >= FlexBuffer->Size)
+            Position -= FlexBuffer->Size;
+
+        memcpy(&FlexBuffer->Data[Position], &Record, sizeof(FLEX_RECORD));
+
+        Length = FLEX_RECORD_LENGTH(Length);
+    }
+
+    /* The range is in the data before the last resize */
+    if (FlexBuffer->Stale[0])
+    {
+        FLEX_StoreRange(FlexBuffer, FlexBuffer->Cursor[0].Index, Range, Length);
+        FLEX_DropStale(FlexBuffer, 0);
+    }
+
+    /* The rest of the ranges stays free */
+    if (Length)
+    {
+        FLEX_Produce(FlexBuffer, Length);
+    }
+
+    FLEX_Unlock(FlexBuffer);
     return true;
 }
 
-bool FLEX_PutRdBuffer(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range)
+bool FLEX_PutRdBufferEx(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Length)
 {
-    if (!FlexBuffer || !Range)
+    if (!FlexBuffer || !Range || Length > FLEX_RangeLength(Range))
     {
         return false;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
-
-    if (Ret)
+    if (!FLEX_Lock(FlexBuffer))
         return false;
 
-    if (!FlexBuffer->Dequeued[1])
+    /* Data held by transfers is put by FLEX_CompleteRd */
+    if (!FlexBuffer->Cursor[1].Dequeued || FlexBuffer->Cursor[1].Held || FlexBuffer->Cursor[1].Transferring)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        FLEX_Unlock(FlexBuffer);
         return false;
     }
 
-    size_t Length = Range->Size;
-
-    if (Range->Next)
+    if (FLEX_RangeLength(Range) > FLEX_RdLength(FlexBuffer, &FlexBuffer->Cursor[1], FLEX_RangeLength(Range)))
     {
-        Length += Range->Next->Size;
+        FLEX_Unlock(FlexBuffer);
+        return false;
     }
 
-    if (Length > FlexBuffer->Size - FlexBuffer->Length)
+    if (FlexBuffer->Flags & FLEX_FLAG_RECORD)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
-        return false;
+        /* A record is read as a whole */
+        if (Length && Length != FLEX_RangeLength(Range))
+        {
+            FLEX_Unlock(FlexBuffer);
+            return false;
+        }
+
+        if (Length)
+            Length = FlexBuffer->Cursor[1].Record;
     }
 
-    FlexBuffer->Length += Length;
+    FlexBuffer->Cursor[1].Dequeued = false;
 
-    FlexBuffer->Dequeued[1] = false;
+    /* The data was moved along by the resize */
+    if (FlexBuffer->Stale[1])
+    {
+        FLEX_DropStale(FlexBuffer, 1);
+    }
 
-    FLEX_Event_Signal(&FlexBuffer->Event[0]);
+    /* The rest of the ranges is read again next time */
+    if (Length)
+    {
+        FLEX_Consume(FlexBuffer, Length);
+    }
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    FLEX_Unlock(FlexBuffer);
     return true;
 }
 
@@ -611,24 +4249,29 @@ bool FLEX_ReleaseWrBuffer(FLEX_BUFFER *FlexBuffer)
         return false;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
+    /* A reservation in the middle can not be taken back */
+    if (FlexBuffer->Slots)
+    {
+        return false;
+    }
 
-    if (Ret)
+    if (!FLEX_Lock(FlexBuffer))
         return false;
 
-    if (!FlexBuffer->Dequeued[0])
+    if (!FlexBuffer->Cursor[0].Dequeued)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        FLEX_Unlock(FlexBuffer);
         return false;
     }
 
-    FlexBuffer->Dequeued[0] = false;
+    FlexBuffer->Cursor[0].Dequeued = false;
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    if (FlexBuffer->Stale[0])
+    {
+        FLEX_DropStale(FlexBuffer, 0);
+    }
+
+    FLEX_Unlock(FlexBuffer);
     return true;
 }
 
@@ -639,24 +4282,24 @@ bool FLEX_ReleaseRdBuffer(FLEX_BUFFER *FlexBuffer)
         return false;
     }
 
-#ifdef _WIN32
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, FLEX_INFINITE);
-#else
-    int Ret = FLEX_Mutex_Lock(&FlexBuffer->Mutex, NULL);
-#endif
-
-    if (Ret)
+    if (!FLEX_Lock(FlexBuffer))
         return false;
 
-    if (!FlexBuffer->Dequeued[1])
+    /* Data held by transfers is put by FLEX_CompleteRd */
+    if (!FlexBuffer->Cursor[1].Dequeued || FlexBuffer->Cursor[1].Held || FlexBuffer->Cursor[1].Transferring)
     {
-        FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+        FLEX_Unlock(FlexBuffer);
         return false;
     }
 
-    FlexBuffer->Dequeued[1] = false;
+    FlexBuffer->Cursor[1].Dequeued = false;
 
-    FLEX_Mutex_Unlock(&FlexBuffer->Mutex);
+    if (FlexBuffer->Stale[1])
+    {
+        FLEX_DropStale(FlexBuffer, 1);
+    }
+
+    FLEX_Unlock(FlexBuffer);
     return true;
 }
 
@@ -664,7 +4307,7 @@ uint8_t * FLEX_GetRangeData(FLEX_RANGE *Range, size_t *Size)
 {
     if (!Range || !Size)
         return NULL;
-    
+
     *Size = Range->Size;
 
     return Range->Data;
@@ -683,3 +4326,23 @@ uint8_t * FLEX_GetExtraData(FLEX_RANGE *Range, size_t *Size)
     return Range->Next->Data;
 }
 
+uint8_t * FLEX_GetRangeDataAt(FLEX_RANGE *Range, size_t Offset, size_t *Size)
+{
+    if (!Size)
+        return NULL;
+
+    for (FLEX_RANGE *Part = Range; Part; Part = Part->Next)
+    {
+        if (Offset < Part->Size)
+        {
+            *Size = Part->Size - Offset;
+
+            return Part->Data + Offset;
+        }
+
+        Offset -= Part->Size;
+    }
+
+    return NULL;
+}
+
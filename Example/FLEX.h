@@ -46,6 +46,102 @@
 //                                                                         //
 // 8. Use FLEX_RestoreBuffer to restore the buffer to initial empty state. //
 //                                                                         //
+// 9. Use FLEX_CreateBufferEx with FLEX_FLAG_LOCKFREE for lock-free single //
+//    producer and single consumer. The producer owns the write index and  //
+//    the consumer owns the read index, and the mutex is only taken when a //
+//    side has to sleep. Get and Put of one side must then be called from  //
+//    one thread at a time.                                                //
+//                                                                         //
+// 10. Use FLEX_FLAG_MIRROR to map the buffer memory twice, back to back,  //
+//     so that any range is one contiguous pointer and FLEX_GetExtraData   //
+//     never returns data. The size is rounded up to page size, which can  //
+//     be read back with FLEX_PeekWrLength on the new instance.            //
+//                                                                         //
+// 11. Use FLEX_FLAG_MULTI_PRODUCER to let several producers get and put   //
+//     write ranges at the same time. Each FLEX_GetWrBuffer reserves its   //
+//     own range, and ranges are passed to the consumer in the order they  //
+//     were reserved, whatever the order of FLEX_PutWrBuffer. Write ranges //
+//     can not be released in this mode.                                   //
+//                                                                         //
+// 12. Use FLEX_FLAG_BROADCAST to pass the same data to several readers    //
+//     without a copy per reader. Each reader is attached by               //
+//     FLEX_AttachReader and reads with its own FLEX_GetReaderBuffer and   //
+//     FLEX_PutReaderBuffer. A lossy reader is evicted instead of holding  //
+//     back the producer.                                                  //
+//                                                                         //
+// 13. Use FLEX_FLAG_MULTI_RESERVE to let one producer get more write      //
+//     ranges before the previous ones are put, for example to keep        //
+//     several DMA transfers queued. Ranges are passed to the consumer in  //
+//     the order they were got. Use FLEX_SetReserveDepth to limit the      //
+//     number of outstanding ranges.                                       //
+//                                                                         //
+// 14. Use FLEX_FLAG_RECORD to pass variable-length records instead of     //
+//     bytes. FLEX_GetWrRecord gets a record of given length to write, and //
+//     FLEX_GetRdRecord gets exactly one complete record. Record headers   //
+//     and padding at the end of buffer are handled by Flex Buffer.        //
+//                                                                         //
+// 15. Use FLEX_GetRdPattern to get data up to a delimiter or a sync word. //
+//     The search uses SSE2/AVX2 when available, finds a pattern across    //
+//     the end of buffer, and does not search the same bytes twice.        //
+//                                                                         //
+// 16. Use FLEX_SetFrameFormat and FLEX_GetRdFrame to get complete frames  //
+//     with a length field, such as frames received from TCP. Each call    //
+//     returns one whole frame without a copy.                             //
+//                                                                         //
+// 17. Use FLEX_ReadFd and FLEX_WriteFd to pass data between the buffer    //
+//     and a socket, pipe or file. Each call takes one readv/writev, even  //
+//     when the ranges wrap around, and puts only the bytes transferred.   //
+//                                                                         //
+// 18. Use FLEX_SpliceRd or FLEX_SendZeroCopy to pass data to a pipe or a  //
+//     socket without a copy. The data stays held until the kernel is done //
+//     with it, and FLEX_CompleteRd puts it back for write.                //
+//                                                                         //
+// 19. Use FLEX_CreateEngine and FLEX_AddEngineStream to drive reads and   //
+//     writes of many instances from one thread with FLEX_RunEngine.       //
+//     io_uring with fixed buffers is used when available, non-blocking    //
+//     readv/writev otherwise.                                             //
+//                                                                         //
+// 20. Use FLEX_CreateFileBuffer to keep the buffer in a memory-mapped     //
+//     file. Data put and not yet read is still there when the file is     //
+//     opened again after the process ends or crashes. Use FLEX_SyncBuffer //
+//     to write it to the storage.                                         //
+//                                                                         //
+// 21. Use FLEX_CreateSharedBuffer to keep the buffer in shared memory.    //
+//     Another process gets the same instance with FLEX_AttachSharedBuffer //
+//     by name, or with FLEX_AttachSharedBufferFd by a passed fd, and one  //
+//     process puts while the other gets.                                  //
+//                                                                         //
+// 22. Use FLEX_FLAG_HUGE_PAGES, FLEX_FLAG_NUMA_NODE,                      //
+//     FLEX_FLAG_LOCK_MEMORY and FLEX_FLAG_PREFAULT for large buffers, to  //
+//     avoid page faults and TLB misses while data streams.                //
+//     FLEX_GetBufferFlags tells which of them took effect.                //
+//                                                                         //
+// 23. Use FLEX_FLAG_ELASTIC for many buffers sized for peaks. Pages are   //
+//     committed as data is written and given back as it drains, see       //
+//     FLEX_SetElasticPolicy and FLEX_TrimBuffer. FLEX_GetResidentBytes    //
+//     tells how much memory the data takes.                               //
+//                                                                         //
+// 24. Use FLEX_WriteBytes and FLEX_ReadBytes to copy data in or out in    //
+//     one call, across the end of buffer. Large copies use non-temporal   //
+//     SSE2/AVX2 stores, so that they do not evict the cache.              //
+//                                                                         //
+// 25. Use FLEX_FLAG_CRC32C to keep running CRC32C checksums of data put   //
+//     and read. FLEX_CompareChecksums checks them whenever the buffer     //
+//     runs empty, to catch data changed in the buffer.                    //
+//                                                                         //
+// 26. Use FLEX_ResizeBuffer to grow or shrink a locked-mode buffer while  //
+//     both sides run. Buffered data is kept in order, and a Get or Put    //
+//     waits no longer than the copy of it.                                //
+//                                                                         //
+// 27. Use FLEX_PeekRdData to look at readable bytes at any offset, and    //
+//     FLEX_SkipRdData to drop bytes, without getting a range. Parsers can //
+//     decide how much to consume byte by byte.                            //
+//                                                                         //
+// 28. Use FLEX_GetRdBlocks to get every whole block readable, up to a     //
+//     count, in one call, and put them all back with one                  //
+//     FLEX_PutRdBuffer. A consumer that falls behind then pays for one    //
+//     lock per batch, not per block.                                      //
+//                                                                         //
 // Application Note                                                        //
 //                                                                         //
 // 1. Data streaming. Employ Flex Buffer as dynamic speed balancer between //
@@ -74,6 +170,60 @@
 
 typedef struct FLEX_BUFFER FLEX_BUFFER;
 typedef struct FLEX_RANGE  FLEX_RANGE;
+typedef struct FLEX_ENGINE FLEX_ENGINE;
+
+/* Creation flags for FLEX_CreateBufferEx */
+#define FLEX_FLAG_LOCKFREE          0x00000001UL    /* Lock-free single producer and single consumer */
+#define FLEX_FLAG_MIRROR            0x00000002UL    /* Mirrored memory, ranges are never separated */
+#define FLEX_FLAG_EVENTFD           0x00000004UL    /* Readiness file descriptors for event loops */
+#define FLEX_FLAG_MULTI_PRODUCER    0x00000008UL    /* Multiple producers, implies FLEX_FLAG_MULTI_RESERVE */
+#define FLEX_FLAG_BROADCAST         0x00000010UL    /* Every reader reads all data, implies FLEX_FLAG_LOCKFREE */
+#define FLEX_FLAG_MULTI_RESERVE     0x00000020UL    /* Several outstanding write ranges, implies FLEX_FLAG_LOCKFREE */
+#define FLEX_FLAG_RECORD            0x00000040UL    /* Variable-length records instead of bytes */
+#define FLEX_FLAG_HUGE_PAGES        0x00000080UL    /* Huge pages for the data, from the pool or transparent */
+#define FLEX_FLAG_LOCK_MEMORY       0x00000100UL    /* Lock the data in physical memory */
+#define FLEX_FLAG_PREFAULT          0x00000200UL    /* Fault in all pages of the data on creation */
+#define FLEX_FLAG_ELASTIC           0x00000400UL    /* Pages of the data are committed on use and released when idle */
+#define FLEX_FLAG_CRC32C            0x00000800UL    /* Running CRC32C of data put and read */
+
+/* Bind the data to a NUMA node (0 to 254), combined with the creation flags */
+#define FLEX_FLAG_NUMA_SHIFT        24
+#define FLEX_FLAG_NUMA_MASK         0xFF000000UL
+#define FLEX_FLAG_NUMA_NODE(Node)   ((((uint32_t)(Node) + 1) << FLEX_FLAG_NUMA_SHIFT) & FLEX_FLAG_NUMA_MASK)
+
+/* Maximum number of readers attached in broadcast mode */
+#define FLEX_MAX_READERS 16
+
+/* Maximum number of outstanding write ranges in multi-reserve mode */
+#define FLEX_MAX_RESERVATIONS 64
+
+/* Maximum pattern length of FLEX_GetRdPattern */
+#define FLEX_MAX_PATTERN 16
+
+/* Maximum number of transfers waiting for completion, see FLEX_CompleteRd */
+#define FLEX_MAX_TRANSFERS 64
+
+/* Maximum number of streams of an engine */
+#define FLEX_MAX_STREAMS 64
+
+/* Copies of FLEX_WriteBytes and FLEX_ReadBytes from this size on bypass the cache */
+#define FLEX_STREAM_THRESHOLD (256 * 1024)
+
+/* Engine flags, see FLEX_GetEngineFlags */
+#define FLEX_ENGINE_URING           0x00000001UL    /* io_uring is used, otherwise readv/writev and poll */
+#define FLEX_ENGINE_FIXED           0x00000002UL    /* Buffers are registered as io_uring fixed buffers */
+
+/* Checksum comparison, see FLEX_CompareChecksums */
+#define FLEX_CHECKSUM_MATCH     0
+#define FLEX_CHECKSUM_PENDING   1
+#define FLEX_CHECKSUM_MISMATCH  2
+
+/* Stream status, see FLEX_GetEngineStream */
+#define FLEX_STREAM_ACTIVE  0
+#define FLEX_STREAM_EOF     1
+
+/* Deadline that never expires, see FLEX_GetTime */
+#define FLEX_DEADLINE_INFINITE 0xFFFFFFFFFFFFFFFFULL
 
 /**
  * Create an instance for given size and alignment
@@ -85,6 +235,191 @@ typedef struct FLEX_RANGE  FLEX_RANGE;
  */
 FLEX_BUFFER *FLEX_CreateBuffer(size_t Size, size_t Alignment);
 
+/**
+ * Create an instance for given size, alignment and creation flags
+ *
+ * @param Size      Buffer size in bytes (> 0)
+ * @param Alignment Memory alignment (power of 2), 0 if not required
+ * @param Flags     Combination of FLEX_FLAG_XXX, 0 for FLEX_CreateBuffer behavior
+ *
+ * @return Instance pointer or NULL for error
+ *
+ * @note With FLEX_FLAG_MIRROR, Size is rounded up to page size and Alignment is ignored.
+ *       With FLEX_FLAG_RECORD, Size is rounded up to a multiple of 8.
+ *       Page options FLEX_FLAG_HUGE_PAGES, FLEX_FLAG_NUMA_NODE, FLEX_FLAG_LOCK_MEMORY and
+ *       FLEX_FLAG_PREFAULT apply to the data of any instance and do not fail creation.
+ *       Without a mirror the data is mapped anonymously, so Alignment must not exceed
+ *       the page size. Huge pages come from the hugetlbfs pool if it has enough free,
+ *       otherwise transparent huge pages are advised. See FLEX_GetBufferFlags for the
+ *       options that took effect.
+ *       FLEX_FLAG_ELASTIC reserves the data without committing it, see FLEX_SetElasticPolicy.
+ *       It cannot be combined with FLEX_FLAG_MIRROR, multi-reserve, broadcast or page
+ *       options other than FLEX_FLAG_NUMA_NODE.
+ *       FLEX_FLAG_CRC32C cannot be combined with FLEX_FLAG_BROADCAST.
+ */
+FLEX_BUFFER *FLEX_CreateBufferEx(size_t Size, size_t Alignment, uint32_t Flags);
+
+/**
+ * Create an instance backed by a memory-mapped file, or reopen one
+ *
+ * @param Path  File path, created if it does not exist
+ * @param Size  Buffer size in bytes (> 0), the same as when the file was created
+ * @param Flags Combination of FLEX_FLAG_LOCKFREE, FLEX_FLAG_EVENTFD and FLEX_FLAG_RECORD
+ *
+ * @return Instance pointer or NULL for error, also if the file holds another buffer
+ *
+ * @note The file holds a header page followed by the data. Indices are stored in the
+ *       header as data is put, at the cost of one store, so a reopened buffer resumes
+ *       with the data put and not yet read. Ranges got and not put when the process
+ *       ended are lost for write and read again for read. Data survives a process crash
+ *       as it is; use FLEX_SyncBuffer to make it durable against a system crash.
+ *       One process opens a file at a time.
+ * @note Page options other than FLEX_FLAG_HUGE_PAGES apply to the mapped data, as
+ *       for FLEX_CreateBufferEx.
+ */
+FLEX_BUFFER *FLEX_CreateFileBuffer(const char *Path, size_t Size, uint32_t Flags);
+
+/**
+ * Write data and indices of a file-backed instance to the storage
+ *
+ * @param FlexBuffer Instance pointer (not NULL), created by FLEX_CreateFileBuffer
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note Data put after the last call may be lost by a system crash
+ */
+bool FLEX_SyncBuffer(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Set when an elastic instance gives pages of its data back to the system
+ *
+ * @param FlexBuffer Instance pointer (not NULL), created with FLEX_FLAG_ELASTIC
+ * @param Threshold  Bytes of data at or below which the consumer releases the pages
+ *                   it has read, 0 (default) to release them when the buffer drains
+ * @param IdleMs     Milliseconds without data put or read before FLEX_TrimBuffer
+ *                   releases the free space, 0 (default) for at once
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note Pages fault in again as zeros when the producer writes them. Only whole pages
+ *       are released, and those of a range as it is put back, before the producer can
+ *       reuse them. Use SIZE_MAX as Threshold to release after every read.
+ */
+bool FLEX_SetElasticPolicy(FLEX_BUFFER *FlexBuffer, size_t Threshold, uint32_t IdleMs);
+
+/**
+ * Release the free space of an idle elastic instance
+ *
+ * @param FlexBuffer Instance pointer (not NULL), created with FLEX_FLAG_ELASTIC
+ *
+ * @return Bytes released, 0 if the instance has not been idle for IdleMs of
+ *         FLEX_SetElasticPolicy or was released already
+ *
+ * @note Call it from the producer thread, for example from a timer of its event loop,
+ *       while it holds no write range. The first call after any activity only takes
+ *       note of the time.
+ */
+size_t FLEX_TrimBuffer(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Get resident bytes of the data of an instance
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ *
+ * @return Bytes of data pages in physical memory, or the size of the data if
+ *         unknown (Windows)
+ */
+size_t FLEX_GetResidentBytes(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Get the running checksum of data put, or of data read and put back
+ *
+ * @param FlexBuffer Instance pointer (not NULL), created with FLEX_FLAG_CRC32C
+ * @param Crc        CRC32C of all data passed by the side since creation or restore
+ * @param Bytes      Bytes covered by Crc
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note The producer checksum is updated as data is put and the consumer checksum as
+ *       data is put back after reading, both before the other side can see the data,
+ *       from the bytes in the buffer. Record headers and padding are included. Any
+ *       thread may call these. Producer checksums at given byte counts, passed along
+ *       with the data, can be checked by the consumer at the same counts.
+ */
+bool FLEX_GetWrChecksum(FLEX_BUFFER *FlexBuffer, uint32_t *Crc, uint64_t *Bytes);
+bool FLEX_GetRdChecksum(FLEX_BUFFER *FlexBuffer, uint32_t *Crc, uint64_t *Bytes);
+
+/**
+ * Compare the producer and consumer checksums
+ *
+ * @param FlexBuffer Instance pointer (not NULL), created with FLEX_FLAG_CRC32C
+ *
+ * @return FLEX_CHECKSUM_MATCH or FLEX_CHECKSUM_MISMATCH when all data put has been read,
+ *         FLEX_CHECKSUM_PENDING if data is still in the buffer, or -1 for error
+ *
+ * @note Every time the buffer runs empty is a checkpoint. A mismatch means data was
+ *       changed in the buffer, for example by a stray write into a held range.
+ */
+int FLEX_CompareChecksums(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Get flags of an instance
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ *
+ * @return Creation flags in effect, including implied ones. Page options that did
+ *         not take effect, for example locking beyond RLIMIT_MEMLOCK, are cleared.
+ */
+uint32_t FLEX_GetBufferFlags(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Create an instance in shared memory for use by two processes
+ *
+ * @param Name  Shared memory object name as for shm_open ("/name"), it must not exist,
+ *              or NULL for anonymous memory passed to the other process by its fd
+ * @param Size  Buffer size in bytes (> 0)
+ * @param Flags Combination of FLEX_FLAG_LOCKFREE and FLEX_FLAG_RECORD
+ *
+ * @return Instance pointer or NULL for error, also on Windows
+ *
+ * @note The indices, wait flags and data all live in the shared memory, and waits park
+ *       on process-shared futexes, so the instance is always lock-free. One process is
+ *       the producer and one the consumer. A process that ends holding a range leaves
+ *       it dequeued; FLEX_RestoreBuffer resets the instance. Deleting the instance
+ *       removes the name, processes already attached keep the memory.
+ * @note Page options apply to the data in the creating process, as for
+ *       FLEX_CreateBufferEx. Attaching processes map it without them.
+ */
+FLEX_BUFFER *FLEX_CreateSharedBuffer(const char *Name, size_t Size, uint32_t Flags);
+
+/**
+ * Attach to an instance created by another process with FLEX_CreateSharedBuffer
+ *
+ * @param Name Shared memory object name given to FLEX_CreateSharedBuffer (not NULL)
+ *
+ * @return Instance pointer or NULL for error, delete it with FLEX_DeleteBuffer
+ */
+FLEX_BUFFER *FLEX_AttachSharedBuffer(const char *Name);
+
+/**
+ * Attach to an instance created by another process with FLEX_CreateSharedBuffer
+ *
+ * @param Fd Descriptor of the shared memory, from FLEX_GetSharedFd of the creator and
+ *           inherited or received over a unix socket; it is duplicated
+ *
+ * @return Instance pointer or NULL for error, delete it with FLEX_DeleteBuffer
+ */
+FLEX_BUFFER *FLEX_AttachSharedBufferFd(int Fd);
+
+/**
+ * Get the descriptor of the shared memory of an instance
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ *
+ * @return Descriptor or -1 if the instance is not in shared memory
+ */
+int FLEX_GetSharedFd(FLEX_BUFFER *FlexBuffer);
+
 /**
  * Delete an instance
  *
@@ -120,6 +455,400 @@ void FLEX_RestoreBuffer(FLEX_BUFFER *FlexBuffer);
 FLEX_RANGE *FLEX_GetWrBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds);
 FLEX_RANGE *FLEX_GetRdBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds);
 
+/**
+ * Get buffer ranges for write or read, waiting until an absolute deadline
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Length     Requested length (> 0)
+ * @param Partial    Partial buffer (< Length) allowed when return
+ * @param Deadline   Absolute FLEX_GetTime time, or FLEX_DEADLINE_INFINITE to wait infinitely
+ *
+ * @return Ranges pointer or NULL if no buffer available
+ *
+ * @note Callers in a loop compute the deadline once instead of a timeout per call
+ */
+FLEX_RANGE *FLEX_GetWrBufferUntil(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint64_t Deadline);
+FLEX_RANGE *FLEX_GetRdBufferUntil(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint64_t Deadline);
+
+/**
+ * Get all whole blocks readable, up to a count, as one read range
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Block        Block size in bytes (> 0), 1 to get all readable bytes
+ * @param Count        [IN/OUT] Maximum number of blocks (> 0), set to the number got
+ * @param Milliseconds Wait timeout for the first block, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Range pointer if succeed, otherwise NULL
+ *
+ * @note The wait ends as soon as one block is readable. Block i starts at offset
+ *       i * Block of the range, see FLEX_GetRangeDataAt, and is divided in two parts
+ *       if it runs across the end of buffer.
+ * @note Put the range with FLEX_PutRdBuffer to read all blocks, or FLEX_PutRdBufferEx
+ *       with a multiple of Block to read the first ones. Not supported in record and
+ *       broadcast modes.
+ */
+FLEX_RANGE *FLEX_GetRdBlocks(FLEX_BUFFER *FlexBuffer, size_t Block, size_t *Count, uint32_t Milliseconds);
+
+/**
+ * Attach a reader to an instance created with FLEX_FLAG_BROADCAST
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Lossy      Evict the reader when it keeps the producer from writing,
+ *                   instead of making the producer wait for it
+ *
+ * @return Reader identifier, or -1 if not in broadcast mode or too many readers
+ *
+ * @note The reader starts with the data written after it is attached. Each
+ *       reader is used by one thread at a time. Free buffer for write is the
+ *       smallest one left by the attached readers, and all of it is free when
+ *       no reader is attached.
+ */
+int FLEX_AttachReader(FLEX_BUFFER *FlexBuffer, bool Lossy);
+
+/**
+ * Detach a reader, attached or evicted, so that its identifier can be reused
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Reader     Reader identifier returned by FLEX_AttachReader
+ *
+ * @return true if succeed, otherwise false
+ */
+bool FLEX_DetachReader(FLEX_BUFFER *FlexBuffer, int Reader);
+
+/**
+ * Check whether a reader is still attached
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Reader     Reader identifier returned by FLEX_AttachReader
+ *
+ * @return true if attached, false if evicted or not attached
+ */
+bool FLEX_IsReaderAttached(FLEX_BUFFER *FlexBuffer, int Reader);
+
+/**
+ * Get, put, release or peek buffer ranges of a reader in broadcast mode
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Reader     Reader identifier returned by FLEX_AttachReader
+ *
+ * @note Same as the FLEX_XxxRdXxx functions, which fail in broadcast mode.
+ *       Once a lossy reader is evicted, Get returns NULL and Put returns false,
+ *       and the data read from an outstanding range must be dropped.
+ */
+FLEX_RANGE *FLEX_GetReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader, size_t Length, bool Partial, uint32_t Milliseconds);
+FLEX_RANGE *FLEX_GetReaderBufferUntil(FLEX_BUFFER *FlexBuffer, int Reader, size_t Length, bool Partial, uint64_t Deadline);
+bool FLEX_PutReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader, FLEX_RANGE *Range);
+bool FLEX_PutReaderBufferEx(FLEX_BUFFER *FlexBuffer, int Reader, FLEX_RANGE *Range, size_t Length);
+bool FLEX_ReleaseReaderBuffer(FLEX_BUFFER *FlexBuffer, int Reader);
+size_t FLEX_PeekReaderLength(FLEX_BUFFER *FlexBuffer, int Reader);
+
+/**
+ * Get a record to write or the next record to read, in record mode
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Length       Record length to write (> 0)
+ * @param Milliseconds Wait timeout before return, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Ranges pointer or NULL if no record available
+ *
+ * @note A record is never divided, so FLEX_GetExtraData returns no data. Put the
+ *       record with FLEX_PutWrBuffer or FLEX_PutRdBuffer. FLEX_PutWrBufferEx puts a
+ *       shorter record, and FLEX_PutRdBufferEx takes 0 or the whole record.
+ *       Each record takes 8 bytes of header and is padded to 8 bytes in the buffer.
+ *       A record that does not fit before the end of buffer is written at the start,
+ *       after padding that is put at once. The record then waits for its own length
+ *       only, so any record up to the buffer size is got once the reader has read
+ *       what was put before. Byte Get calls fail in record mode.
+ */
+FLEX_RANGE *FLEX_GetWrRecord(FLEX_BUFFER *FlexBuffer, size_t Length, uint32_t Milliseconds);
+FLEX_RANGE *FLEX_GetRdRecord(FLEX_BUFFER *FlexBuffer, uint32_t Milliseconds);
+
+/**
+ * Find a pattern in data to read, and get ranges that end right after the pattern
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Pattern      Byte pattern to find, such as a delimiter or a sync word (not NULL)
+ * @param Length       Pattern length, 1 to FLEX_MAX_PATTERN
+ * @param Milliseconds Wait timeout for the pattern, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Ranges pointer or NULL if the pattern is not found
+ *
+ * @note The ranges include the data before the first match and the match itself,
+ *       and are put or released as FLEX_GetRdBuffer ranges. Bytes searched in vain
+ *       are remembered, so that a call for the same pattern only searches new data.
+ *       A match is never found if the buffer is full without one.
+ */
+FLEX_RANGE *FLEX_GetRdPattern(FLEX_BUFFER *FlexBuffer, const uint8_t *Pattern, size_t Length, uint32_t Milliseconds);
+
+/**
+ * Set the format of frames got by FLEX_GetRdFrame
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Offset     Offset of the length field from the frame start in bytes
+ * @param Width      Width of the length field, 1, 2, 4 or 8 bytes
+ * @param BigEndian  Length field is big-endian (network byte order), otherwise little-endian
+ * @param Adjust     Added to the length field value, for example -Offset - Width if the
+ *                   field counts the whole frame
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note The frame length is Offset + Width + field value + Adjust bytes
+ */
+bool FLEX_SetFrameFormat(FLEX_BUFFER *FlexBuffer, size_t Offset, size_t Width, bool BigEndian, int Adjust);
+
+/**
+ * Get the next complete frame to read, as set by FLEX_SetFrameFormat
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Milliseconds Wait timeout for the whole frame, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Ranges pointer or NULL with errno set. errno is ETIMEDOUT if no complete frame
+ *         is available, or EBADMSG if the length field gives a frame shorter than its
+ *         header or longer than the buffer. EINVAL or EBUSY are set if the frame format
+ *         is not set or ranges to read are already got
+ *
+ * @note The ranges hold the whole frame, header included, without a copy, and are
+ *       put or released as FLEX_GetRdBuffer ranges. A bad header stays at the read
+ *       index, use FLEX_SkipRdData to drop bytes until the stream is in sync again.
+ */
+FLEX_RANGE *FLEX_GetRdFrame(FLEX_BUFFER *FlexBuffer, uint32_t Milliseconds);
+
+/**
+ * Copy data into free buffer and put it, or get data, copy it out and put it back
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Data         Data to write, or memory to read into (not NULL)
+ * @param Length       Bytes to copy (> 0)
+ * @param Partial      true to copy what is available if less than Length
+ * @param Milliseconds Wait timeout for free buffer or data, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Bytes copied and put, 0 if not available in time
+ *
+ * @note Copies from FLEX_STREAM_THRESHOLD bytes on use non-temporal SSE2/AVX2 stores,
+ *       chosen at run time, so that they do not evict the working set of the other
+ *       side from the cache. Not supported in record mode, FLEX_ReadBytes is not
+ *       supported in broadcast mode.
+ */
+size_t FLEX_WriteBytes(FLEX_BUFFER *FlexBuffer, const void *Data, size_t Length, bool Partial, uint32_t Milliseconds);
+size_t FLEX_ReadBytes(FLEX_BUFFER *FlexBuffer, void *Data, size_t Length, bool Partial, uint32_t Milliseconds);
+
+/**
+ * Copy readable data at an offset from the read index without reading it
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Offset       Readable bytes to pass over (< buffer size)
+ * @param Data         Memory to copy into (not NULL)
+ * @param Length       Bytes to copy (> 0)
+ * @param Milliseconds Wait timeout for Offset + Length readable bytes, or FLEX_INFINITE
+ *                     to wait infinitely, 0 to copy what is readable now
+ *
+ * @return Bytes copied, fewer than Length if not readable in time
+ *
+ * @note The copy runs across the end of buffer. It does not dequeue, so it may be
+ *       called while a read range is got, and the data stays readable.
+ * @note Called by the consumer only. Not supported in record and broadcast modes.
+ */
+size_t FLEX_PeekRdData(FLEX_BUFFER *FlexBuffer, size_t Offset, void *Data, size_t Length, uint32_t Milliseconds);
+
+/**
+ * Discard data as if it were got and put, without getting a range
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Length       Bytes to discard (> 0)
+ * @param Partial      true to discard what is available if less than Length
+ * @param Milliseconds Wait timeout for data, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Bytes discarded, 0 if not available in time
+ *
+ * @note Fails while a read range is got or data is held by transfers. Called by the
+ *       consumer only. Not supported in record and broadcast modes.
+ */
+size_t FLEX_SkipRdData(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partial, uint32_t Milliseconds);
+
+/**
+ * Read from a file descriptor into free buffer, or write data to a file descriptor
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Fd           File descriptor, such as a socket, pipe or file, blocking or non-blocking
+ * @param Length       Maximum bytes to transfer (> 0)
+ * @param Milliseconds Wait timeout for free buffer or data, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Bytes transferred and put, or -1 with errno set. FLEX_ReadFd returns 0 at end of file,
+ *         and fails with ENOBUFS if no free buffer. FLEX_WriteFd returns 0 if no data.
+ *         EAGAIN is passed through from non-blocking descriptors.
+ *
+ * @note Ranges that wrap around are transferred with one readv/writev call, and short
+ *       transfers put only the bytes transferred. Milliseconds waits for the buffer,
+ *       never for the descriptor. Not supported in multi-reserve and record modes,
+ *       FLEX_WriteFd is not supported in broadcast mode, and both fail with ENOSYS on Windows.
+ */
+int64_t FLEX_ReadFd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds);
+int64_t FLEX_WriteFd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds);
+
+/**
+ * Splice data to read into a pipe, or send it with MSG_ZEROCOPY, without a copy
+ *
+ * @param FlexBuffer   Instance pointer (not NULL)
+ * @param Fd           Pipe write end for FLEX_SpliceRd, or TCP/UDP socket with SO_ZEROCOPY
+ *                     set for FLEX_SendZeroCopy
+ * @param Length       Maximum bytes to transfer (> 0)
+ * @param Milliseconds Wait timeout for data, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Bytes transferred, 0 if no data, or -1 with errno set. EAGAIN is passed
+ *         through from non-blocking descriptors, and ENOBUFS is returned when
+ *         FLEX_MAX_TRANSFERS transfers are waiting for completion.
+ *
+ * @note The kernel refers to the buffer until the transfer completes, so the data
+ *       stays held instead of being put. Use FLEX_CompleteRd to put it back for write
+ *       once completed. Further transfers continue after the held data, and other
+ *       read calls fail until all of it is completed. Completions are matched by
+ *       counting sends, so a socket must not have sent with MSG_ZEROCOPY before, and
+ *       another socket can only be used once all sends are completed. Not supported
+ *       in broadcast and record modes, Linux only.
+ */
+int64_t FLEX_SpliceRd(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds);
+int64_t FLEX_SendZeroCopy(FLEX_BUFFER *FlexBuffer, int Fd, size_t Length, uint32_t Milliseconds);
+
+/**
+ * Put back data held by completed transfers to a descriptor, without waiting
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Fd         Descriptor passed to FLEX_SpliceRd or FLEX_SendZeroCopy
+ *
+ * @return Bytes put, or -1 with errno set
+ *
+ * @note A zero-copy send completes when its notification is got from the socket
+ *       error queue. A splice completes when the pipe reader has read its data, which
+ *       must then be copied, not spliced on. Data is put in the order it was transferred.
+ */
+int64_t FLEX_CompleteRd(FLEX_BUFFER *FlexBuffer, int Fd);
+
+/**
+ * Create an I/O engine, which moves data between descriptors and buffers from one thread
+ *
+ * @param Depth Maximum number of operations in flight over all streams (> 0)
+ *
+ * @return Engine pointer or NULL if failed
+ *
+ * @note io_uring is used when supported, and falls back to non-blocking readv/writev
+ *       and poll otherwise. See FLEX_GetEngineFlags.
+ */
+FLEX_ENGINE *FLEX_CreateEngine(uint32_t Depth);
+
+/**
+ * Delete an engine, cancelling operations in flight
+ *
+ * @param Engine Engine pointer (not NULL)
+ *
+ * @return None
+ *
+ * @note Ranges got for operations in flight are released
+ */
+void FLEX_DeleteEngine(FLEX_ENGINE *Engine);
+
+/**
+ * Get flags of an engine
+ *
+ * @param Engine Engine pointer (not NULL)
+ *
+ * @return Combination of FLEX_ENGINE_XXX
+ */
+uint32_t FLEX_GetEngineFlags(FLEX_ENGINE *Engine);
+
+/**
+ * Add a stream, which reads from a descriptor into free buffer, or writes data to a descriptor
+ *
+ * @param Engine     Engine pointer (not NULL)
+ * @param FlexBuffer Instance pointer (not NULL), which must outlive the stream
+ * @param Fd         File descriptor, non-blocking if io_uring is not used
+ * @param Write      Write data to Fd, otherwise read from Fd
+ * @param Length     Maximum bytes of one operation (> 0)
+ *
+ * @return Stream index, or -1 if failed
+ *
+ * @note The engine is the producer of a read stream, or the consumer of a write stream.
+ *       A stream has one operation in flight at a time, as data must be put in order.
+ *       Both parts of a wrapped range are transferred by that operation. The buffer is
+ *       registered as an io_uring fixed buffer when supported, and used for ranges in
+ *       one part. Not supported in multi-reserve and record modes, nor for write streams
+ *       in broadcast mode.
+ */
+int FLEX_AddEngineStream(FLEX_ENGINE *Engine, FLEX_BUFFER *FlexBuffer, int Fd, bool Write, size_t Length);
+
+/**
+ * Remove a stream
+ *
+ * @param Engine Engine pointer (not NULL)
+ * @param Stream Stream index
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note An operation in flight is cancelled, and the stream index is only reused
+ *       once FLEX_RunEngine has got its completion
+ */
+bool FLEX_RemoveEngineStream(FLEX_ENGINE *Engine, int Stream);
+
+/**
+ * Get the status of a stream
+ *
+ * @param Engine Engine pointer (not NULL)
+ * @param Stream Stream index
+ * @param Bytes  Bytes transferred by the stream, may be NULL
+ *
+ * @return FLEX_STREAM_ACTIVE, FLEX_STREAM_EOF after a read stream reached end of file,
+ *         or a negative error code after an operation failed
+ */
+int FLEX_GetEngineStream(FLEX_ENGINE *Engine, int Stream, uint64_t *Bytes);
+
+/**
+ * Start operations for streams with free buffer or data, and put ranges as they complete
+ *
+ * @param Engine       Engine pointer (not NULL)
+ * @param Milliseconds Wait timeout for a completion, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Number of completed operations, or -1 with errno set
+ *
+ * @note Returns at once if no operation can be started or is in flight, for example
+ *       when all read streams have full buffers. Short transfers put only the bytes
+ *       transferred. A stream stops at end of file or on error, see FLEX_GetEngineStream.
+ */
+int FLEX_RunEngine(FLEX_ENGINE *Engine, uint32_t Milliseconds);
+
+/**
+ * Get monotonic time used by deadlines
+ *
+ * @return Time in nanoseconds, not affected by wall clock changes
+ */
+uint64_t FLEX_GetTime(void);
+
+/**
+ * Set the wait policy used when a Get call has to wait
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param SpinCount  Number of pause-instruction spins before yielding
+ * @param YieldCount Number of thread yields before sleeping
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note The default is 0 and 0, which sleeps at once. Spinning only pays off
+ *       when the producer and the consumer run on different cores.
+ */
+bool FLEX_SetWaitPolicy(FLEX_BUFFER *FlexBuffer, uint32_t SpinCount, uint32_t YieldCount);
+
+/**
+ * Set how many write ranges may be outstanding at the same time
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Depth      Number of ranges, 1 to FLEX_MAX_RESERVATIONS
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note Only for FLEX_FLAG_MULTI_RESERVE or FLEX_FLAG_MULTI_PRODUCER, where the
+ *       default is FLEX_MAX_RESERVATIONS. The depth is shared by all producers.
+ *       Get waits while Depth ranges are outstanding.
+ */
+bool FLEX_SetReserveDepth(FLEX_BUFFER *FlexBuffer, size_t Depth);
+
 /**
  * Put buffer ranges for read or write back to the instance
  *
@@ -133,6 +862,22 @@ FLEX_RANGE *FLEX_GetRdBuffer(FLEX_BUFFER *FlexBuffer, size_t Length, bool Partia
 bool FLEX_PutWrBuffer(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range);
 bool FLEX_PutRdBuffer(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range);
 
+/**
+ * Put the first Length bytes of buffer ranges for read or write back to the instance
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Range      Ranges to put, returned by FLEX_GetWrBuffer or FLEX_GetRdBuffer (not NULL)
+ * @param Length     Bytes written or read, up to the size of the ranges
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note The rest of the ranges is returned as if released, that is, free buffer for
+ *       write again and data for read again. In multi-reserve mode, only the latest
+ *       write range can be put partially.
+ */
+bool FLEX_PutWrBufferEx(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Length);
+bool FLEX_PutRdBufferEx(FLEX_BUFFER *FlexBuffer, FLEX_RANGE *Range, size_t Length);
+
 /**
  * Release buffer ranges for write or read again later
  *
@@ -152,11 +897,64 @@ bool FLEX_ReleaseRdBuffer(FLEX_BUFFER *FlexBuffer);
  *
  * @return Snapshot of buffer length if succeed, otherwise 0
  *
- * @note The length may have changed after the function returns
+ * @note The length may have changed after the function returns. In lock-free mode,
+ *       another thread peeks the two indices at different times without the mutex,
+ *       and the length is kept within the buffer size.
  */
 size_t FLEX_PeekWrLength(FLEX_BUFFER *FlexBuffer);
 size_t FLEX_PeekRdLength(FLEX_BUFFER *FlexBuffer);
 
+/**
+ * Grow or shrink an instance while the producer and the consumer run
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Size       New buffer size in bytes (> 0), rounded up as by FLEX_CreateBufferEx
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note Buffered data is moved in order to new memory allocated with the same flags.
+ *       The sides wait for the mutex only while the data is copied.
+ * @note Only instances in locked mode can be resized, not file-backed, shared or
+ *       record-mode ones. It fails if Size is below the buffered data plus a write
+ *       range got, while data is held by transfers or streamed by an engine, and
+ *       until the ranges got before a previous resize have been put or released.
+ * @note Ranges got before stay valid until they are put or released, and the data
+ *       written to them is moved by FLEX_PutWrBuffer. It must not be called
+ *       concurrently with FLEX_TrimBuffer or FLEX_GetResidentBytes.
+ */
+bool FLEX_ResizeBuffer(FLEX_BUFFER *FlexBuffer, size_t Size);
+
+/**
+ * Get readiness file descriptors of an instance created with FLEX_FLAG_EVENTFD
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ *
+ * @return File descriptor, or -1 if not available
+ *
+ * @note FLEX_GetWrEventFd gets readable when there may be free buffer to write,
+ *       and FLEX_GetRdEventFd gets readable when there may be data to read.
+ *       A descriptor is armed when a Get with zero timeout on that side fails,
+ *       and raised by the next Put of the peer. Read the 8-byte counter from the
+ *       descriptor to reset it, then call Get with zero timeout until it fails.
+ *       The write descriptor starts readable. Not supported on Windows.
+ */
+int FLEX_GetWrEventFd(FLEX_BUFFER *FlexBuffer);
+int FLEX_GetRdEventFd(FLEX_BUFFER *FlexBuffer);
+
+/**
+ * Peek wake-up counters of both sides (snapshot only)
+ *
+ * @param FlexBuffer Instance pointer (not NULL)
+ * @param Signaled   [OUT] Return the number of wake-ups that signaled a sleeping peer
+ * @param Elided     [OUT] Return the number of wake-ups that skipped the signal
+ *
+ * @return true if succeed, otherwise false
+ *
+ * @note Each elided wake-up is a kernel transition saved. Counters wrap around.
+ *       Wake-ups of producers waiting for a slot and of evicted readers are counted too.
+ */
+bool FLEX_PeekWakeCount(FLEX_BUFFER *FlexBuffer, size_t *Signaled, size_t *Elided);
+
 /**
  * Retrive data buffer held by the range. At the end of circular
  * buffer, the requested buffer may be separated into two parts. 
@@ -186,4 +984,18 @@ uint8_t *FLEX_GetRangeData(FLEX_RANGE *Range, size_t *Size);
 */
 uint8_t *FLEX_GetExtraData(FLEX_RANGE *Range, size_t *Size);
 
+/**
+ * Retrive the data at an offset of the range, in whichever part it is
+ *
+ * @param Range  Range pointer (not NULL)
+ * @param Offset Offset in bytes from the start of the range
+ * @param Size   [OUT] Return the contiguous size in bytes from the offset
+ *
+ * @return Data buffer pointer, NULL if Offset is past the range
+ *
+ * @note A block of up to Size bytes from Offset is contiguous, otherwise the rest
+ *       of it is at Offset + Size.
+*/
+uint8_t *FLEX_GetRangeDataAt(FLEX_RANGE *Range, size_t Offset, size_t *Size);
+
 #endif // __FLEX_H__
\ No newline at end of file
@@ -2,6 +2,71 @@
 
 #include "FLEX_OS.h"
 
+#include <errno.h>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/* Sparse fixed buffer tables came last, with kernel 5.19 headers. Older
+ * headers build FLEX_Uring_XXX as stubs, and engines fall back to poll.
+ */
+#if defined(IORING_RSRC_REGISTER_SPARSE) && defined(IORING_ENTER_EXT_ARG) && defined(__NR_io_uring_setup)
+#define FLEX_HAVE_URING
+#endif
+
+/* Older headers do not have zero-copy send */
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLEX_SIMD
+#endif
+
+#ifdef FLEX_SIMD
+#include <immintrin.h>
+#ifndef _WIN32
+#include <cpuid.h>
+#endif
+#endif
+
+/* AVX2 and SSE4.2 kernels are built for their instruction sets, and only
+ * called when the processor supports them. MSVC allows the intrinsics
+ * anywhere.
+ */
+#ifdef _WIN32
+#define FLEX_TARGET_AVX2
+#define FLEX_TARGET_SSE42
+#else
+#define FLEX_TARGET_AVX2 __attribute__((target("avx2")))
+#define FLEX_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+
 int FLEX_CreateMutex(FLEX_MUTEX *Mutex)
 {
 #ifdef _WIN32
@@ -50,7 +115,59 @@ int FLEX_CreateEvent(FLEX_EVENT *Event)
 
     return 0;
 #else
-    return pthread_cond_init(Event, NULL);
+    pthread_condattr_t Attr;
+
+    int Ret = pthread_condattr_init(&Attr);
+
+    if (Ret)
+        return Ret;
+
+    /* Timed waits must not be stretched by wall clock changes */
+    Ret = pthread_condattr_setclock(&Attr, CLOCK_MONOTONIC);
+
+    if (Ret == 0)
+        Ret = pthread_cond_init(&Event->Cond, &Attr);
+
+    pthread_condattr_destroy(&Attr);
+
+    Event->Fd = -1;
+    Event->HasFd = false;
+
+    return Ret;
+#endif
+}
+
+int FLEX_CreateEventFd(FLEX_EVENT *Event)
+{
+#ifdef _WIN32
+    return ERROR_NOT_SUPPORTED;
+#else
+    if (Event->HasFd)
+    {
+        return 0;
+    }
+
+    /* Non-blocking, so that an event loop can drain it with read */
+    int Fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (Fd < 0)
+    {
+        return errno;
+    }
+
+    Event->Fd = Fd;
+    Event->HasFd = true;
+
+    return 0;
+#endif
+}
+
+int FLEX_Event_GetFd(FLEX_EVENT *Event)
+{
+#ifdef _WIN32
+    return -1;
+#else
+    return Event->HasFd ? Event->Fd : -1;
 #endif
 }
 
@@ -66,7 +183,13 @@ int FLEX_DeleteEvent(FLEX_EVENT *Event)
 
     return 0;
 #else
-    return pthread_cond_destroy(Event);
+    if (Event->HasFd)
+    {
+        close(Event->Fd);
+        Event->HasFd = false;
+    }
+
+    return pthread_cond_destroy(&Event->Cond);
 #endif
 }
 
@@ -135,10 +258,10 @@ int FLEX_Event_Wait(FLEX_EVENT *Event, FLEX_MUTEX *Mutex, struct timespec *Tp)
 #else
     if (Tp)
     {
-        return pthread_cond_timedwait(Event, Mutex, Tp);
+        return pthread_cond_timedwait(&Event->Cond, Mutex, Tp);
     }
     else
-        return pthread_cond_wait(Event, Mutex);
+        return pthread_cond_wait(&Event->Cond, Mutex);
 #endif
 }
 
@@ -156,33 +279,1681 @@ int FLEX_Event_Signal(FLEX_EVENT *Event)
     else
         return (int)GetLastError();
 #else
-    return pthread_cond_signal(Event);
+    return pthread_cond_signal(&Event->Cond);
 #endif
 }
 
-void * FLEX_Aligned_Malloc(size_t Size, size_t Alignment)
+int FLEX_Event_Notify(FLEX_EVENT *Event)
 {
 #ifdef _WIN32
-    return _aligned_malloc(Size, Alignment);
+    return ERROR_NOT_SUPPORTED;
 #else
-    void *Ptr;
+    if (!Event->HasFd)
+    {
+        return EBADF;
+    }
 
-    int Ret = posix_memalign(&Ptr, Alignment, Size);
+    uint64_t Value = 1;
 
-    if (Ret)
-        return NULL;
+    /* EAGAIN means the counter is saturated, which is still readable */
+    if (write(Event->Fd, &Value, sizeof(Value)) < 0 && errno != EAGAIN)
+    {
+        return errno;
+    }
 
-    return Ptr;
+    return 0;
 #endif
+}
 
-    return NULL;
+uint64_t FLEX_Clock_Now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER Frequency; /* Fixed at boot */
+
+    LARGE_INTEGER Counter;
+
+    if (Frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&Frequency);
+    }
+
+    QueryPerformanceCounter(&Counter);
+
+    /* Split to prevent from overflow */
+    uint64_t Seconds = (uint64_t)(Counter.QuadPart / Frequency.QuadPart);
+    uint64_t Remains = (uint64_t)(Counter.QuadPart % Frequency.QuadPart);
+
+    return Seconds * 1000000000ULL + Remains * 1000000000ULL / Frequency.QuadPart;
+#else
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+#endif
 }
 
-void FLEX_Aligned_Free(void *Memory)
+void FLEX_Thread_Yield(void)
 {
 #ifdef _WIN32
-    _aligned_free(Memory);
+    SwitchToThread();
 #else
-    free(Memory);
+    sched_yield();
+#endif
+}
+
+#ifndef _WIN32
+int FLEX_Futex_Wait(volatile size_t *Ptr, size_t Value, uint64_t Deadline, bool Shared)
+{
+    struct timespec Ts;
+
+    Ts.tv_sec  = (time_t)(Deadline / 1000000000ULL);
+    Ts.tv_nsec = (long)(Deadline % 1000000000ULL);
+
+    /* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline. The
+     * futex word is the low half of the size_t on little-endian x86/x64.
+     */
+    int Op = Shared ? FUTEX_WAIT_BITSET : (FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG);
+
+    long Ret = syscall(SYS_futex, (uint32_t *)Ptr, Op, (uint32_t)Value,
+        Deadline == FLEX_DEADLINE_INFINITE ? NULL : &Ts, NULL, FUTEX_BITSET_MATCH_ANY);
+
+    if (Ret && errno == ETIMEDOUT)
+    {
+        return ETIMEDOUT;
+    }
+
+    /* EAGAIN and EINTR are treated as spurious wake-ups */
+    return 0;
+}
+
+int FLEX_Futex_Wake(volatile size_t *Ptr, bool Shared)
+{
+    /* Private futexes are keyed by address, shared ones by page */
+    int Op = Shared ? FUTEX_WAKE : (FUTEX_WAKE | FUTEX_PRIVATE_FLAG);
+
+    long Ret = syscall(SYS_futex, (uint32_t *)Ptr, Op, INT32_MAX, NULL, NULL, 0);
+
+    return Ret < 0 ? errno : 0;
+}
+#endif
+
+uint32_t FLEX_Cpu_Features(void)
+{
+    static volatile uint32_t Features = 0xFFFFFFFFUL; /* Not checked yet */
+
+    if (Features != 0xFFFFFFFFUL)
+    {
+        return Features;
+    }
+
+    uint32_t Result = 0;
+
+#ifdef FLEX_SIMD
+    uint32_t Regs[4];
+
+#ifdef _WIN32
+    __cpuid((int *)Regs, 1);
+#else
+    __cpuid(1, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+
+    if (Regs[3] & (1UL << 26))
+        Result |= FLEX_CPU_SSE2;
+
+    if (Regs[2] & (1UL << 20))
+        Result |= FLEX_CPU_SSE42;
+
+    /* AVX needs OSXSAVE, and the OS must save the YMM state */
+    if ((Regs[2] & (1UL << 27)) && (Regs[2] & (1UL << 28)))
+    {
+#ifdef _WIN32
+        uint64_t Xcr0 = _xgetbv(0);
+#else
+        uint32_t Lo, Hi;
+
+        __asm__ __volatile__ ("xgetbv" : "=a" (Lo), "=d" (Hi) : "c" (0));
+
+        uint64_t Xcr0 = ((uint64_t)Hi << 32) | Lo;
+#endif
+
+#ifdef _WIN32
+        __cpuidex((int *)Regs, 7, 0);
+#else
+        __cpuid_count(7, 0, Regs[0], Regs[1], Regs[2], Regs[3]);
+#endif
+
+        if ((Xcr0 & 6) == 6 && (Regs[1] & (1UL << 5)))
+            Result |= FLEX_CPU_AVX2;
+    }
+#endif
+
+    Features = Result;
+
+    return Result;
+}
+
+static inline uint32_t FLEX_Bit_Scan(uint32_t Mask)
+{
+#ifdef _WIN32
+    unsigned long Index;
+
+    _BitScanForward(&Index, Mask);
+
+    return (uint32_t)Index;
+#else
+    return (uint32_t)__builtin_ctz(Mask);
+#endif
+}
+
+/* Match candidates are offsets where both the first and the last byte of
+ * the pattern match, and are checked by memcmp. If no match is found, the
+ * kernel returns false with *Offset where the scalar tail starts.
+ */
+#ifdef FLEX_SIMD
+static bool FLEX_Find_SSE2(const uint8_t *Data, size_t Size, const uint8_t *Pattern, size_t Length, size_t *Offset)
+{
+    size_t i;
+
+    __m128i First = _mm_set1_epi8((char)Pattern[0]);
+    __m128i Last = _mm_set1_epi8((char)Pattern[Length - 1]);
+
+    for (i = 0; i + 16 + Length - 1 <= Size; i += 16)
+    {
+        __m128i A = _mm_loadu_si128((const __m128i *)(Data + i));
+        __m128i B = _mm_loadu_si128((const __m128i *)(Data + i + Length - 1));
+
+        uint32_t Mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(A, First), _mm_cmpeq_epi8(B, Last)));
+
+        while (Mask)
+        {
+            uint32_t Bit = FLEX_Bit_Scan(Mask);
+
+            if (memcmp(Data + i + Bit, Pattern, Length) == 0)
+            {
+                *Offset = i + Bit;
+                return true;
+            }
+
+            Mask &= Mask - 1;
+        }
+    }
+
+    *Offset = i;
+    return false;
+}
+
+static FLEX_TARGET_AVX2 bool FLEX_Find_AVX2(const uint8_t *Data, size_t Size, const uint8_t *Pattern, size_t Length, size_t *Offset)
+{
+    size_t i;
+
+    __m256i First = _mm256_set1_epi8((char)Pattern[0]);
+    __m256i Last = _mm256_set1_epi8((char)Pattern[Length - 1]);
+
+    for (i = 0; i + 32 + Length - 1 <= Size; i += 32)
+    {
+        __m256i A = _mm256_loadu_si256((const __m256i *)(Data + i));
+        __m256i B = _mm256_loadu_si256((const __m256i *)(Data + i + Length - 1));
+
+        uint32_t Mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(A, First), _mm256_cmpeq_epi8(B, Last)));
+
+        while (Mask)
+        {
+            uint32_t Bit = FLEX_Bit_Scan(Mask);
+
+            if (memcmp(Data + i + Bit, Pattern, Length) == 0)
+            {
+                *Offset = i + Bit;
+                return true;
+            }
+
+            Mask &= Mask - 1;
+        }
+    }
+
+    *Offset = i;
+    return false;
+}
+#endif
+
+/* Blocks the SSE4.2 kernel checksums three at a time */
+#define FLEX_CRC_LONG   8192
+#define FLEX_CRC_SHORT  256
+
+/* Slice-by-8 tables of the reflected polynomial, and tables to shift a
+ * checksum over a long or short block of zeros. Filled once on first use,
+ * FLEX_Crc_Ready goes from 0 to 1 while filling and to 2 when published.
+ */
+static uint32_t FLEX_Crc_Table[8][256];
+static uint32_t FLEX_Crc_Long[4][256];
+static uint32_t FLEX_Crc_Short[4][256];
+static volatile size_t FLEX_Crc_Ready = 0;
+
+/* Multiply a vector by a 32 x 32 matrix over GF(2) */
+static uint32_t FLEX_Crc_Times(const uint32_t *Matrix, uint32_t Vector)
+{
+    uint32_t Sum = 0;
+
+    for (; Vector; Vector >>= 1, Matrix++)
+    {
+        if (Vector & 1)
+            Sum ^= *Matrix;
+    }
+
+    return Sum;
+}
+
+static void FLEX_Crc_Square(uint32_t *Square, const uint32_t *Matrix)
+{
+    for (int n = 0; n < 32; n++)
+        Square[n] = FLEX_Crc_Times(Matrix, Matrix[n]);
+}
+
+/* Tables of the operator that appends Length zero bytes to a checksum */
+static void FLEX_Crc_Zeros(uint32_t Zeros[4][256], size_t Length)
+{
+    uint32_t Even[32];
+    uint32_t Odd[32];
+    uint32_t Row = 1;
+    int n;
+
+    /* One zero bit */
+    Odd[0] = 0x82F63B78UL;
+
+    for (n = 1; n < 32; n++, Row <<= 1)
+        Odd[n] = Row;
+
+    /* Two, then four zero bits */
+    FLEX_Crc_Square(Even, Odd);
+    FLEX_Crc_Square(Odd, Even);
+
+    /* Square up to one zero byte and on, by the bits of Length */
+    uint32_t *Op = Odd;
+
+    for (;;)
+    {
+        FLEX_Crc_Square(Even, Odd);
+        Op = Even;
+        Length >>= 1;
+
+        if (!Length)
+            break;
+
+        FLEX_Crc_Square(Odd, Even);
+        Op = Odd;
+        Length >>= 1;
+
+        if (!Length)
+            break;
+    }
+
+    for (n = 0; n < 256; n++)
+    {
+        Zeros[0][n] = FLEX_Crc_Times(Op, (uint32_t)n);
+        Zeros[1][n] = FLEX_Crc_Times(Op, (uint32_t)n << 8);
+        Zeros[2][n] = FLEX_Crc_Times(Op, (uint32_t)n << 16);
+        Zeros[3][n] = FLEX_Crc_Times(Op, (uint32_t)n << 24);
+    }
+}
+
+static inline uint32_t FLEX_Crc_Shift(uint32_t Zeros[4][256], uint32_t Crc)
+{
+    return Zeros[0][Crc & 0xFF] ^ Zeros[1][(Crc >> 8) & 0xFF] ^ Zeros[2][(Crc >> 16) & 0xFF] ^ Zeros[3][Crc >> 24];
+}
+
+static void FLEX_Crc_Fill(void)
+{
+    uint32_t i;
+    uint32_t j;
+
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t Crc = i;
+
+        for (j = 0; j < 8; j++)
+            Crc = (Crc >> 1) ^ ((Crc & 1) ? 0x82F63B78UL : 0);
+
+        FLEX_Crc_Table[0][i] = Crc;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        for (j = 1; j < 8; j++)
+            FLEX_Crc_Table[j][i] = (FLEX_Crc_Table[j - 1][i] >> 8) ^ FLEX_Crc_Table[0][FLEX_Crc_Table[j - 1][i] & 0xFF];
+    }
+
+    FLEX_Crc_Zeros(FLEX_Crc_Long, FLEX_CRC_LONG);
+    FLEX_Crc_Zeros(FLEX_Crc_Short, FLEX_CRC_SHORT);
+}
+
+static inline void FLEX_Crc_Init(void)
+{
+    if (FLEX_Atomic_Load(&FLEX_Crc_Ready) == 2)
+        return;
+
+    /* One thread fills the tables, the others wait for the release store */
+    if (FLEX_Atomic_CompareExchange(&FLEX_Crc_Ready, 0, 1))
+    {
+        FLEX_Crc_Fill();
+        FLEX_Atomic_Store(&FLEX_Crc_Ready, 2);
+        return;
+    }
+
+    while (FLEX_Atomic_Load(&FLEX_Crc_Ready) != 2)
+        FLEX_Thread_Yield();
+}
+
+static uint32_t FLEX_Crc32c_Table(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+    FLEX_Crc_Init();
+
+    for (; Size >= 8; Size -= 8, Data += 8)
+    {
+        uint32_t Lo;
+        uint32_t Hi;
+
+        memcpy(&Lo, Data, 4);
+        memcpy(&Hi, Data + 4, 4);
+
+        Lo ^= Crc;
+
+        Crc = FLEX_Crc_Table[7][Lo & 0xFF] ^ FLEX_Crc_Table[6][(Lo >> 8) & 0xFF] ^
+            FLEX_Crc_Table[5][(Lo >> 16) & 0xFF] ^ FLEX_Crc_Table[4][Lo >> 24] ^
+            FLEX_Crc_Table[3][Hi & 0xFF] ^ FLEX_Crc_Table[2][(Hi >> 8) & 0xFF] ^
+            FLEX_Crc_Table[1][(Hi >> 16) & 0xFF] ^ FLEX_Crc_Table[0][Hi >> 24];
+    }
+
+    for (; Size; Size--, Data++)
+        Crc = (Crc >> 8) ^ FLEX_Crc_Table[0][(Crc ^ *Data) & 0xFF];
+
+    return Crc;
+}
+
+#ifdef FLEX_SIMD
+static FLEX_TARGET_SSE42 uint32_t FLEX_Crc32c_SSE42(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t Crc64 = Crc;
+
+    /* crc32 has a latency of three cycles and a throughput of one, so
+     * three blocks are checksummed at once and then combined
+     */
+    static const size_t Blocks[2] = { FLEX_CRC_LONG, FLEX_CRC_SHORT };
+
+    if (Size >= 3 * FLEX_CRC_SHORT)
+    {
+        FLEX_Crc_Init();
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        size_t Block = Blocks[i];
+
+        for (; Size >= 3 * Block; Size -= 3 * Block, Data += 3 * Block)
+        {
+            uint64_t Crc1 = 0;
+            uint64_t Crc2 = 0;
+
+            for (size_t j = 0; j < Block; j += 8)
+            {
+                uint64_t Word[3];
+
+                memcpy(&Word[0], Data + j, 8);
+                memcpy(&Word[1], Data + j + Block, 8);
+                memcpy(&Word[2], Data + j + 2 * Block, 8);
+
+                Crc64 = _mm_crc32_u64(Crc64, Word[0]);
+                Crc1 = _mm_crc32_u64(Crc1, Word[1]);
+                Crc2 = _mm_crc32_u64(Crc2, Word[2]);
+            }
+
+            uint32_t (*Zeros)[256] = (i == 0) ? FLEX_Crc_Long : FLEX_Crc_Short;
+
+            Crc64 = FLEX_Crc_Shift(Zeros, (uint32_t)Crc64) ^ Crc1;
+            Crc64 = FLEX_Crc_Shift(Zeros, (uint32_t)Crc64) ^ Crc2;
+        }
+    }
+
+    for (; Size >= 8; Size -= 8, Data += 8)
+    {
+        uint64_t Word;
+
+        memcpy(&Word, Data, 8);
+        Crc64 = _mm_crc32_u64(Crc64, Word);
+    }
+
+    Crc = (uint32_t)Crc64;
+#endif
+
+    for (; Size >= 4; Size -= 4, Data += 4)
+    {
+        uint32_t Word;
+
+        memcpy(&Word, Data, 4);
+        Crc = _mm_crc32_u32(Crc, Word);
+    }
+
+    for (; Size; Size--, Data++)
+        Crc = _mm_crc32_u8(Crc, *Data);
+
+    return Crc;
+}
 #endif
-}
\ No newline at end of file
+
+uint32_t FLEX_Crc32c(uint32_t Crc, const uint8_t *Data, size_t Size)
+{
+    /* The register holds the inverted checksum */
+    Crc = ~Crc;
+
+#ifdef FLEX_SIMD
+    if (FLEX_Cpu_Features() & FLEX_CPU_SSE42)
+    {
+        return ~FLEX_Crc32c_SSE42(Crc, Data, Size);
+    }
+#endif
+
+    return ~FLEX_Crc32c_Table(Crc, Data, Size);
+}
+
+/* The destination is aligned for the stores, the source may not be. Each
+ * kernel returns the bytes it copied, the rest is left to memcpy.
+ */
+#ifdef FLEX_SIMD
+static size_t FLEX_Copy_SSE2(uint8_t *Dst, const uint8_t *Src, size_t Size)
+{
+    size_t i;
+
+    for (i = 0; i + 64 <= Size; i += 64)
+    {
+        __m128i A = _mm_loadu_si128((const __m128i *)(Src + i));
+        __m128i B = _mm_loadu_si128((const __m128i *)(Src + i + 16));
+        __m128i C = _mm_loadu_si128((const __m128i *)(Src + i + 32));
+        __m128i D = _mm_loadu_si128((const __m128i *)(Src + i + 48));
+
+        _mm_stream_si128((__m128i *)(Dst + i), A);
+        _mm_stream_si128((__m128i *)(Dst + i + 16), B);
+        _mm_stream_si128((__m128i *)(Dst + i + 32), C);
+        _mm_stream_si128((__m128i *)(Dst + i + 48), D);
+    }
+
+    return i;
+}
+
+static FLEX_TARGET_AVX2 size_t FLEX_Copy_AVX2(uint8_t *Dst, const uint8_t *Src, size_t Size)
+{
+    size_t i;
+
+    for (i = 0; i + 128 <= Size; i += 128)
+    {
+        __m256i A = _mm256_loadu_si256((const __m256i *)(Src + i));
+        __m256i B = _mm256_loadu_si256((const __m256i *)(Src + i + 32));
+        __m256i C = _mm256_loadu_si256((const __m256i *)(Src + i + 64));
+        __m256i D = _mm256_loadu_si256((const __m256i *)(Src + i + 96));
+
+        _mm256_stream_si256((__m256i *)(Dst + i), A);
+        _mm256_stream_si256((__m256i *)(Dst + i + 32), B);
+        _mm256_stream_si256((__m256i *)(Dst + i + 64), C);
+        _mm256_stream_si256((__m256i *)(Dst + i + 96), D);
+    }
+
+    return i;
+}
+#endif
+
+void FLEX_Copy_Stream(void *Dst, const void *Src, size_t Size)
+{
+    uint8_t *To = (uint8_t *)Dst;
+    const uint8_t *From = (const uint8_t *)Src;
+
+#ifdef FLEX_SIMD
+    uint32_t Features = FLEX_Cpu_Features();
+
+    if (Features & (FLEX_CPU_SSE2 | FLEX_CPU_AVX2))
+    {
+        /* Head up to a cache line boundary of the destination */
+        size_t Head = (size_t)(-(intptr_t)To & (FLEX_CACHE_LINE - 1));
+
+        if (Head > Size)
+            Head = Size;
+
+        memcpy(To, From, Head);
+
+        To += Head;
+        From += Head;
+        Size -= Head;
+
+        size_t Done = (Features & FLEX_CPU_AVX2) ? FLEX_Copy_AVX2(To, From, Size) : FLEX_Copy_SSE2(To, From, Size);
+
+        /* Streaming stores are weakly ordered */
+        _mm_sfence();
+
+        To += Done;
+        From += Done;
+        Size -= Done;
+    }
+#endif
+
+    memcpy(To, From, Size);
+}
+
+size_t FLEX_Find_Pattern(const uint8_t *Data, size_t Size, const uint8_t *Pattern, size_t Length)
+{
+    size_t i = 0;
+
+    if (Size < Length)
+    {
+        return Size;
+    }
+
+#ifdef FLEX_SIMD
+    bool Found;
+
+    if (FLEX_Cpu_Features() & FLEX_CPU_AVX2)
+    {
+        Found = FLEX_Find_AVX2(Data, Size, Pattern, Length, &i);
+    }
+    else
+        Found = FLEX_Find_SSE2(Data, Size, Pattern, Length, &i);
+
+    if (Found)
+    {
+        return i;
+    }
+#endif
+
+    /* The tail shorter than a vector */
+    for (; i + Length <= Size; i++)
+    {
+        if (Data[i] == Pattern[0] && memcmp(Data + i, Pattern, Length) == 0)
+        {
+            return i;
+        }
+    }
+
+    return Size;
+}
+
+int64_t FLEX_Fd_Read(int Fd, uint8_t **Data, size_t *Size, int Count)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct iovec Iov[2];
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Iov[i].iov_base = Data[i];
+        Iov[i].iov_len = Size[i];
+    }
+
+    ssize_t Ret;
+
+    do
+    {
+        Ret = readv(Fd, Iov, Count);
+    } while (Ret < 0 && errno == EINTR);
+
+    return (int64_t)Ret;
+#endif
+}
+
+int64_t FLEX_Fd_Write(int Fd, uint8_t **Data, size_t *Size, int Count)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct iovec Iov[2];
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Iov[i].iov_base = Data[i];
+        Iov[i].iov_len = Size[i];
+    }
+
+    ssize_t Ret;
+
+    do
+    {
+        Ret = writev(Fd, Iov, Count);
+    } while (Ret < 0 && errno == EINTR);
+
+    return (int64_t)Ret;
+#endif
+}
+
+int64_t FLEX_Fd_Splice(int Fd, uint8_t **Data, size_t *Size, int Count)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct iovec Iov[2];
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Iov[i].iov_base = Data[i];
+        Iov[i].iov_len = Size[i];
+    }
+
+    ssize_t Ret;
+
+    /* Without SPLICE_F_GIFT the pipe refers to the pages until they are read */
+    do
+    {
+        Ret = vmsplice(Fd, Iov, Count, 0);
+    } while (Ret < 0 && errno == EINTR);
+
+    return (int64_t)Ret;
+#endif
+}
+
+int64_t FLEX_Fd_SendZeroCopy(int Fd, uint8_t **Data, size_t *Size, int Count)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct iovec Iov[2];
+    struct msghdr Msg;
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        Iov[i].iov_base = Data[i];
+        Iov[i].iov_len = Size[i];
+    }
+
+    memset(&Msg, 0, sizeof(Msg));
+
+    Msg.msg_iov = Iov;
+    Msg.msg_iovlen = Count;
+
+    ssize_t Ret;
+
+    do
+    {
+        Ret = sendmsg(Fd, &Msg, MSG_ZEROCOPY);
+    } while (Ret < 0 && errno == EINTR);
+
+    return (int64_t)Ret;
+#endif
+}
+
+int FLEX_Fd_ZeroCopyDone(int Fd, uint32_t *Lo, uint32_t *Hi)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    /* Room for one IPv4 or IPv6 extended error */
+    uint8_t Control[128];
+    struct msghdr Msg;
+
+    memset(&Msg, 0, sizeof(Msg));
+
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+
+    ssize_t Ret;
+
+    do
+    {
+        Ret = recvmsg(Fd, &Msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    } while (Ret < 0 && errno == EINTR);
+
+    if (Ret < 0)
+    {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    for (struct cmsghdr *Cmsg = CMSG_FIRSTHDR(&Msg); Cmsg; Cmsg = CMSG_NXTHDR(&Msg, Cmsg))
+    {
+        if ((Cmsg->cmsg_level == SOL_IP && Cmsg->cmsg_type == IP_RECVERR) ||
+            (Cmsg->cmsg_level == SOL_IPV6 && Cmsg->cmsg_type == IPV6_RECVERR))
+        {
+            struct sock_extended_err *Err = (struct sock_extended_err *)CMSG_DATA(Cmsg);
+
+            if (Err->ee_errno == 0 && Err->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            {
+                *Lo = Err->ee_info;
+                *Hi = Err->ee_data;
+                return 1;
+            }
+        }
+    }
+
+    /* An error queued by the network, not a completion */
+    errno = EPROTO;
+    return -1;
+#endif
+}
+
+int FLEX_Fd_Unread(int Fd, size_t *Count)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    int Unread;
+
+    if (ioctl(Fd, FIONREAD, &Unread) < 0)
+    {
+        return -1;
+    }
+
+    *Count = (size_t)Unread;
+
+    return 0;
+#endif
+}
+
+int FLEX_Fd_Poll(const int *Fd, const bool *Write, int Count, uint32_t Milliseconds)
+{
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct pollfd Poll[FLEX_MAX_STREAMS];
+    int i;
+
+    if (Count > FLEX_MAX_STREAMS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        Poll[i].fd = Fd[i];
+        Poll[i].events = Write[i] ? POLLOUT : POLLIN;
+        Poll[i].revents = 0;
+    }
+
+    /* Not restarted, the caller polls again */
+    return poll(Poll, Count, (Milliseconds == FLEX_INFINITE) ? -1 : (int)Milliseconds);
+#endif
+}
+
+int FLEX_Uring_Create(FLEX_URING *Uring, uint32_t Entries, uint32_t Fixed)
+{
+    memset(Uring, 0, sizeof(FLEX_URING));
+
+    Uring->Fd = -1;
+
+#ifndef FLEX_HAVE_URING
+    (void)Entries;
+    (void)Fixed;
+    return ENOSYS;
+#else
+    struct io_uring_params Params;
+
+    memset(&Params, 0, sizeof(Params));
+
+    int Fd = (int)syscall(__NR_io_uring_setup, Entries, &Params);
+
+    if (Fd < 0)
+    {
+        return errno;
+    }
+
+    /* Reads and writes at the current position are needed for pipes and
+     * sockets, vectors that are read at submission for FLEX_Uring_Prepare,
+     * and timed waits for FLEX_Uring_Submit.
+     */
+    if (!(Params.features & IORING_FEAT_RW_CUR_POS) || !(Params.features & IORING_FEAT_SUBMIT_STABLE) ||
+        !(Params.features & IORING_FEAT_EXT_ARG))
+    {
+        close(Fd);
+        return ENOSYS;
+    }
+
+    Uring->Fd = Fd;
+
+    Uring->SqRingSize = Params.sq_off.array + Params.sq_entries * sizeof(uint32_t);
+    Uring->CqRingSize = Params.cq_off.cqes + Params.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* Both rings share one mapping on newer kernels */
+    if (Params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (Uring->CqRingSize > Uring->SqRingSize)
+            Uring->SqRingSize = Uring->CqRingSize;
+
+        Uring->CqRingSize = Uring->SqRingSize;
+    }
+
+    Uring->SqRing = mmap(NULL, Uring->SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+
+    if (Uring->SqRing == MAP_FAILED)
+    {
+        Uring->SqRing = NULL;
+        FLEX_Uring_Delete(Uring);
+        return ENOMEM;
+    }
+
+    if (Params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        Uring->CqRing = Uring->SqRing;
+    }
+    else
+    {
+        Uring->CqRing = mmap(NULL, Uring->CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+
+        if (Uring->CqRing == MAP_FAILED)
+        {
+            Uring->CqRing = NULL;
+            FLEX_Uring_Delete(Uring);
+            return ENOMEM;
+        }
+    }
+
+    Uring->SqesSize = Params.sq_entries * sizeof(struct io_uring_sqe);
+    Uring->Sqes = mmap(NULL, Uring->SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+
+    if (Uring->Sqes == MAP_FAILED)
+    {
+        Uring->Sqes = NULL;
+        FLEX_Uring_Delete(Uring);
+        return ENOMEM;
+    }
+
+    /* Vectors of each entry, FLEX_URING_PARTS per entry */
+    Uring->Iovecs = malloc(Params.sq_entries * FLEX_URING_PARTS * sizeof(struct iovec));
+
+    if (!Uring->Iovecs)
+    {
+        FLEX_Uring_Delete(Uring);
+        return ENOMEM;
+    }
+
+    uint8_t *Sq = (uint8_t *)Uring->SqRing;
+    uint8_t *Cq = (uint8_t *)Uring->CqRing;
+
+    Uring->SqHead = (volatile uint32_t *)(Sq + Params.sq_off.head);
+    Uring->SqTail = (volatile uint32_t *)(Sq + Params.sq_off.tail);
+    Uring->SqArray = (uint32_t *)(Sq + Params.sq_off.array);
+    Uring->SqMask = *(uint32_t *)(Sq + Params.sq_off.ring_mask);
+    Uring->SqEntries = Params.sq_entries;
+    Uring->SqLocal = *Uring->SqTail;
+
+    Uring->CqHead = (volatile uint32_t *)(Cq + Params.cq_off.head);
+    Uring->CqTail = (volatile uint32_t *)(Cq + Params.cq_off.tail);
+    Uring->Cqes = Cq + Params.cq_off.cqes;
+    Uring->CqMask = *(uint32_t *)(Cq + Params.cq_off.ring_mask);
+
+    /* Slots are filled in one by one later, older kernels can not */
+    if (Fixed)
+    {
+        struct io_uring_rsrc_register Register;
+
+        memset(&Register, 0, sizeof(Register));
+
+        Register.nr = Fixed;
+        Register.flags = IORING_RSRC_REGISTER_SPARSE;
+
+        Uring->Fixed = syscall(__NR_io_uring_register, Fd, IORING_REGISTER_BUFFERS2, &Register, sizeof(Register)) == 0;
+    }
+
+    return 0;
+#endif
+}
+
+void FLEX_Uring_Delete(FLEX_URING *Uring)
+{
+#ifndef _WIN32
+    if (Uring->Sqes)
+        munmap(Uring->Sqes, Uring->SqesSize);
+
+    if (Uring->CqRing && Uring->CqRing != Uring->SqRing)
+        munmap(Uring->CqRing, Uring->CqRingSize);
+
+    if (Uring->SqRing)
+        munmap(Uring->SqRing, Uring->SqRingSize);
+
+    if (Uring->Fd >= 0)
+        close(Uring->Fd);
+#endif
+
+    free(Uring->Iovecs);
+
+    memset(Uring, 0, sizeof(FLEX_URING));
+
+    Uring->Fd = -1;
+}
+
+int FLEX_Uring_Register(FLEX_URING *Uring, uint32_t Index, void *Data, size_t Size)
+{
+#ifndef FLEX_HAVE_URING
+    (void)Uring;
+    (void)Index;
+    (void)Data;
+    (void)Size;
+    return ENOSYS;
+#else
+    if (!Uring->Fixed)
+    {
+        return EINVAL;
+    }
+
+    struct iovec Iov;
+    struct io_uring_rsrc_update2 Update;
+
+    Iov.iov_base = Data;
+    Iov.iov_len = Data ? Size : 0;
+
+    memset(&Update, 0, sizeof(Update));
+
+    Update.offset = Index;
+    Update.data = (uint64_t)(uintptr_t)&Iov;
+    Update.nr = 1;
+
+    /* Returns the number of slots updated */
+    if (syscall(__NR_io_uring_register, Uring->Fd, IORING_REGISTER_BUFFERS_UPDATE, &Update, sizeof(Update)) < 0)
+    {
+        return errno;
+    }
+
+    return 0;
+#endif
+}
+
+#ifdef FLEX_HAVE_URING
+static struct io_uring_sqe *FLEX_Uring_GetSqe(FLEX_URING *Uring, uint32_t *Slot)
+{
+    uint32_t Head = __atomic_load_n(Uring->SqHead, __ATOMIC_ACQUIRE);
+
+    if (Uring->SqLocal - Head >= Uring->SqEntries)
+    {
+        return NULL;
+    }
+
+    uint32_t Index = Uring->SqLocal & Uring->SqMask;
+
+    struct io_uring_sqe *Sqe = &((struct io_uring_sqe *)Uring->Sqes)[Index];
+
+    memset(Sqe, 0, sizeof(struct io_uring_sqe));
+
+    Uring->SqArray[Index] = Index;
+    Uring->SqLocal++;
+
+    if (Slot)
+        *Slot = Index;
+
+    return Sqe;
+}
+#endif
+
+bool FLEX_Uring_Prepare(FLEX_URING *Uring, int Op, int Fd, uint8_t **Data, size_t *Size, int Count, int Fixed, uint64_t UserData)
+{
+#ifndef FLEX_HAVE_URING
+    (void)Uring;
+    (void)Op;
+    (void)Fd;
+    (void)Data;
+    (void)Size;
+    (void)Count;
+    (void)Fixed;
+    (void)UserData;
+    return false;
+#else
+    if (Count < 1 || Count > FLEX_URING_PARTS)
+    {
+        return false;
+    }
+
+    uint32_t Slot;
+    struct io_uring_sqe *Sqe = FLEX_Uring_GetSqe(Uring, &Slot);
+
+    if (!Sqe)
+    {
+        return false;
+    }
+
+    Sqe->fd = Fd;
+    Sqe->off = (uint64_t)-1;        /* Current position */
+    Sqe->user_data = UserData;
+
+    if (Count == 1)
+    {
+        if (Fixed >= 0)
+        {
+            Sqe->opcode = (Op == FLEX_URING_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+            Sqe->buf_index = (uint16_t)Fixed;
+        }
+        else
+            Sqe->opcode = (Op == FLEX_URING_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+
+        Sqe->addr = (uint64_t)(uintptr_t)Data[0];
+        Sqe->len = (uint32_t)((Size[0] < UINT32_MAX) ? Size[0] : UINT32_MAX);
+
+        return true;
+    }
+
+    /* Fixed buffers take one part only. The kernel reads the vectors at
+     * submission, before the entry is reused.
+     */
+    struct iovec *Iov = (struct iovec *)Uring->Iovecs + Slot * FLEX_URING_PARTS;
+
+    for (int i = 0; i < Count; i++)
+    {
+        Iov[i].iov_base = Data[i];
+        Iov[i].iov_len = Size[i];
+    }
+
+    Sqe->opcode = (Op == FLEX_URING_READ) ? IORING_OP_READV : IORING_OP_WRITEV;
+    Sqe->addr = (uint64_t)(uintptr_t)Iov;
+    Sqe->len = (uint32_t)Count;
+
+    return true;
+#endif
+}
+
+bool FLEX_Uring_Cancel(FLEX_URING *Uring, uint64_t Target, uint64_t UserData)
+{
+#ifndef FLEX_HAVE_URING
+    (void)Uring;
+    (void)Target;
+    (void)UserData;
+    return false;
+#else
+    struct io_uring_sqe *Sqe = FLEX_Uring_GetSqe(Uring, NULL);
+
+    if (!Sqe)
+    {
+        return false;
+    }
+
+    Sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    Sqe->fd = -1;
+    Sqe->addr = Target;
+    Sqe->user_data = UserData;
+
+    return true;
+#endif
+}
+
+int FLEX_Uring_Submit(FLEX_URING *Uring, uint32_t Wait, uint32_t Milliseconds)
+{
+#ifndef FLEX_HAVE_URING
+    (void)Uring;
+    (void)Wait;
+    (void)Milliseconds;
+    return ENOSYS;
+#else
+    /* Entries left by a previous call are submitted again */
+    uint32_t Submit = Uring->SqLocal - __atomic_load_n(Uring->SqHead, __ATOMIC_ACQUIRE);
+
+    /* Pairs with the acquire of the kernel, entries are visible first */
+    __atomic_store_n(Uring->SqTail, Uring->SqLocal, __ATOMIC_RELEASE);
+
+    uint32_t Flags = Wait ? IORING_ENTER_GETEVENTS : 0;
+
+    struct __kernel_timespec Timeout;
+    struct io_uring_getevents_arg Arg;
+
+    void *ArgPtr = NULL;
+    size_t ArgSize = 0;
+
+    if (Wait && Milliseconds != FLEX_INFINITE)
+    {
+        Timeout.tv_sec = Milliseconds / 1000;
+        Timeout.tv_nsec = (long long)(Milliseconds % 1000) * 1000000;
+
+        memset(&Arg, 0, sizeof(Arg));
+
+        Arg.ts = (uint64_t)(uintptr_t)&Timeout;
+
+        Flags |= IORING_ENTER_EXT_ARG;
+        ArgPtr = &Arg;
+        ArgSize = sizeof(Arg);
+    }
+
+    if (syscall(__NR_io_uring_enter, Uring->Fd, Submit, Wait, Flags, ArgPtr, ArgSize) < 0)
+    {
+        /* Timed out or interrupted, completions are taken as usual */
+        if (errno == ETIME || errno == EINTR)
+            return 0;
+
+        return errno;
+    }
+
+    return 0;
+#endif
+}
+
+bool FLEX_Uring_Reap(FLEX_URING *Uring, uint64_t *UserData, int32_t *Result)
+{
+#ifndef FLEX_HAVE_URING
+    (void)Uring;
+    (void)UserData;
+    (void)Result;
+    return false;
+#else
+    uint32_t Head = *Uring->CqHead;
+
+    /* Pairs with the release of the kernel, the entry is visible first */
+    if (Head == __atomic_load_n(Uring->CqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    struct io_uring_cqe *Cqe = &((struct io_uring_cqe *)Uring->Cqes)[Head & Uring->CqMask];
+
+    *UserData = Cqe->user_data;
+    *Result = Cqe->res;
+
+    __atomic_store_n(Uring->CqHead, Head + 1, __ATOMIC_RELEASE);
+
+    return true;
+#endif
+}
+
+void * FLEX_Aligned_Malloc(size_t Size, size_t Alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(Size, Alignment);
+#else
+    void *Ptr;
+
+    int Ret = posix_memalign(&Ptr, Alignment, Size);
+
+    if (Ret)
+        return NULL;
+
+    return Ptr;
+#endif
+
+    return NULL;
+}
+
+void FLEX_Aligned_Free(void *Memory)
+{
+#ifdef _WIN32
+    _aligned_free(Memory);
+#else
+    free(Memory);
+#endif
+}
+
+size_t FLEX_Page_Size(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO SystemInfo;
+
+    GetSystemInfo(&SystemInfo);
+
+    /* Views must be mapped at allocation granularity */
+    return SystemInfo.dwAllocationGranularity;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void *FLEX_Mirror_Malloc(size_t Size)
+{
+#ifdef _WIN32
+    HANDLE hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)((uint64_t)Size >> 32), (DWORD)Size, NULL);
+
+    if (hMapping == NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t *Memory = NULL;
+
+    /* The reserved address range is released before the views are
+     * mapped into it, and another thread may take it in between.
+     * Retry a few times in that case.
+     */
+    for (int Retry = 0; Retry < 16 && !Memory; Retry++)
+    {
+        uint8_t *Base = (uint8_t *)VirtualAlloc(NULL, 2 * Size, MEM_RESERVE, PAGE_NOACCESS);
+
+        if (!Base)
+            break;
+
+        VirtualFree(Base, 0, MEM_RELEASE);
+
+        if (!MapViewOfFileEx(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, Size, Base))
+            continue;
+
+        if (!MapViewOfFileEx(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, Size, Base + Size))
+        {
+            UnmapViewOfFile(Base);
+            continue;
+        }
+
+        Memory = Base;
+    }
+
+    /* Views keep the mapping alive */
+    CloseHandle(hMapping);
+
+    return Memory;
+#else
+    int Fd = memfd_create("FLEX", MFD_CLOEXEC);
+
+    if (Fd < 0)
+    {
+        return NULL;
+    }
+
+    if (ftruncate(Fd, (off_t)Size))
+    {
+        close(Fd);
+        return NULL;
+    }
+
+    /* Reserve the whole address range first, then map the same pages
+     * twice over it.
+     */
+    uint8_t *Base = (uint8_t *)mmap(NULL, 2 * Size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (Base == MAP_FAILED)
+    {
+        close(Fd);
+        return NULL;
+    }
+
+    if (mmap(Base, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, Fd, 0) == MAP_FAILED ||
+        mmap(Base + Size, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, Fd, 0) == MAP_FAILED)
+    {
+        munmap(Base, 2 * Size);
+        close(Fd);
+        return NULL;
+    }
+
+    /* Mappings keep the memory alive */
+    close(Fd);
+
+    return Base;
+#endif
+}
+
+void FLEX_Mirror_Free(void *Memory, size_t Size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(Memory);
+    UnmapViewOfFile((uint8_t *)Memory + Size);
+#else
+    munmap(Memory, 2 * Size);
+#endif
+}
+
+size_t FLEX_Huge_Page_Size(void)
+{
+#ifdef _WIN32
+    /* Large pages need a privilege, they are not used */
+    return 0;
+#else
+    FILE *File = fopen("/proc/meminfo", "r");
+
+    if (!File)
+    {
+        return 0;
+    }
+
+    char Line[128];
+    size_t Size = 0;
+
+    while (fgets(Line, sizeof(Line), File))
+    {
+        unsigned long Kilobytes;
+
+        if (sscanf(Line, "Hugepagesize: %lu kB", &Kilobytes) == 1)
+        {
+            Size = (size_t)Kilobytes * 1024;
+            break;
+        }
+    }
+
+    fclose(File);
+
+    return Size;
+#endif
+}
+
+void *FLEX_Pages_Malloc(size_t Size, bool HugeTlb, bool NoReserve)
+{
+#ifdef _WIN32
+    /* Committed pages take no memory until touched */
+    (void)NoReserve;
+
+    if (HugeTlb)
+    {
+        return NULL;
+    }
+
+    return VirtualAlloc(NULL, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    int Flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (HugeTlb)
+        Flags |= MAP_HUGETLB;
+
+    if (NoReserve)
+        Flags |= MAP_NORESERVE;
+
+    void *Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, Flags, -1, 0);
+
+    return Memory == MAP_FAILED ? NULL : Memory;
+#endif
+}
+
+void FLEX_Pages_Free(void *Memory, size_t Size)
+{
+#ifdef _WIN32
+    (void)Size;
+    VirtualFree(Memory, 0, MEM_RELEASE);
+#else
+    munmap(Memory, Size);
+#endif
+}
+
+uint32_t FLEX_Pages_Apply(void *Memory, size_t Size, uint32_t Options, int Node)
+{
+    uint32_t Applied = 0;
+
+#ifdef _WIN32
+    (void)Node;
+#else
+    if ((Options & FLEX_PAGES_HUGE) && !madvise(Memory, Size, MADV_HUGEPAGE))
+    {
+        Applied |= FLEX_PAGES_HUGE;
+    }
+
+    /* mbind without libnuma, moving pages already faulted in */
+    if ((Options & FLEX_PAGES_NODE) && Node >= 0 && Node < 1024)
+    {
+        unsigned long Mask[1024 / (8 * sizeof(unsigned long))] = { 0 };
+
+        Mask[Node / (8 * sizeof(unsigned long))] = 1UL << (Node % (8 * sizeof(unsigned long)));
+
+        if (!syscall(SYS_mbind, Memory, Size, 2 /* MPOL_BIND */, Mask, (unsigned long)(8 * sizeof(Mask) + 1), 2 /* MPOL_MF_MOVE */))
+        {
+            Applied |= FLEX_PAGES_NODE;
+        }
+    }
+#endif
+
+    if (Options & FLEX_PAGES_LOCK)
+    {
+#ifdef _WIN32
+        if (VirtualLock(Memory, Size))
+#else
+        if (!mlock(Memory, Size))
+#endif
+        {
+            Applied |= FLEX_PAGES_LOCK;
+        }
+    }
+
+    if (Options & FLEX_PAGES_PREFAULT)
+    {
+#if !defined(_WIN32) && defined(MADV_POPULATE_WRITE)
+        if (!madvise(Memory, Size, MADV_POPULATE_WRITE))
+        {
+            return Applied | FLEX_PAGES_PREFAULT;
+        }
+#endif
+        size_t PageSize = FLEX_Page_Size();
+
+        /* Older kernels: write each page, keeping the data of mapped files */
+        for (size_t i = 0; i < Size; i += PageSize)
+        {
+            volatile uint8_t *Byte = (volatile uint8_t *)Memory + i;
+
+            *Byte = *Byte;
+        }
+
+        Applied |= FLEX_PAGES_PREFAULT;
+    }
+
+    return Applied;
+}
+
+size_t FLEX_Pages_Release(void *Memory, size_t Size)
+{
+    size_t PageSize = FLEX_Page_Size();
+
+    uintptr_t Begin = ((uintptr_t)Memory + PageSize - 1) & ~(uintptr_t)(PageSize - 1);
+    uintptr_t End = ((uintptr_t)Memory + Size) & ~(uintptr_t)(PageSize - 1);
+
+    if (End <= Begin)
+    {
+        return 0;
+    }
+
+#ifdef _WIN32
+    if (!VirtualAlloc((void *)Begin, End - Begin, MEM_RESET, PAGE_READWRITE))
+#else
+    if (madvise((void *)Begin, End - Begin, MADV_DONTNEED))
+#endif
+    {
+        return 0;
+    }
+
+    return End - Begin;
+}
+
+size_t FLEX_Pages_Resident(void *Memory, size_t Size)
+{
+#ifdef _WIN32
+    (void)Memory;
+    return Size;
+#else
+    size_t PageSize = FLEX_Page_Size();
+
+    uintptr_t Begin = (uintptr_t)Memory & ~(uintptr_t)(PageSize - 1);
+    uintptr_t End = ((uintptr_t)Memory + Size + PageSize - 1) & ~(uintptr_t)(PageSize - 1);
+
+    size_t Resident = 0;
+    unsigned char Vector[256];
+
+    /* A chunk of pages at a time */
+    for (uintptr_t Chunk = Begin; Chunk < End; Chunk += sizeof(Vector) * PageSize)
+    {
+        size_t Length = End - Chunk;
+
+        if (Length > sizeof(Vector) * PageSize)
+            Length = sizeof(Vector) * PageSize;
+
+        if (mincore((void *)Chunk, Length, Vector))
+        {
+            return Size;
+        }
+
+        for (size_t i = 0; i < Length / PageSize; i++)
+        {
+            if (Vector[i] & 1)
+                Resident += PageSize;
+        }
+    }
+
+    return Resident;
+#endif
+}
+
+void *FLEX_File_Map(const char *Path, size_t Size, bool *Created)
+{
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    LARGE_INTEGER FileSize;
+
+    if (!GetFileSizeEx(hFile, &FileSize))
+    {
+        CloseHandle(hFile);
+        return NULL;
+    }
+
+    /* The mapping extends the file with zeros */
+    *Created = (uint64_t)FileSize.QuadPart < (uint64_t)Size;
+
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE,
+        (DWORD)((uint64_t)Size >> 32), (DWORD)Size, NULL);
+
+    CloseHandle(hFile);
+
+    if (hMapping == NULL)
+    {
+        return NULL;
+    }
+
+    void *Memory = MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, Size);
+
+    /* The view keeps the mapping alive */
+    CloseHandle(hMapping);
+
+    return Memory;
+#else
+    int Fd = open(Path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (Fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat Stat;
+
+    if (fstat(Fd, &Stat) < 0)
+    {
+        close(Fd);
+        return NULL;
+    }
+
+    /* Extended bytes read as zeros */
+    *Created = (uint64_t)Stat.st_size < (uint64_t)Size;
+
+    if (*Created && ftruncate(Fd, (off_t)Size) < 0)
+    {
+        close(Fd);
+        return NULL;
+    }
+
+    void *Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+
+    /* The mapping keeps the file open */
+    close(Fd);
+
+    return (Memory == MAP_FAILED) ? NULL : Memory;
+#endif
+}
+
+void *FLEX_Shared_Create(const char *Name, size_t Size, int *Fd)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    int Shm = Name ? shm_open(Name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600) : memfd_create("FLEX", MFD_CLOEXEC);
+
+    if (Shm < 0)
+    {
+        return NULL;
+    }
+
+    void *Memory = MAP_FAILED;
+
+    if (ftruncate(Shm, (off_t)Size) == 0)
+    {
+        Memory = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Shm, 0);
+    }
+
+    if (Memory == MAP_FAILED)
+    {
+        close(Shm);
+
+        if (Name)
+            shm_unlink(Name);
+
+        return NULL;
+    }
+
+    *Fd = Shm;
+
+    return Memory;
+#endif
+}
+
+void *FLEX_Shared_Attach(const char *Name, int Fd, size_t *Size, int *Own)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    int Shm = Name ? shm_open(Name, O_RDWR | O_CLOEXEC, 0) : fcntl(Fd, F_DUPFD_CLOEXEC, 0);
+
+    if (Shm < 0)
+    {
+        return NULL;
+    }
+
+    struct stat Stat;
+
+    if (fstat(Shm, &Stat) < 0 || Stat.st_size <= 0)
+    {
+        close(Shm);
+        return NULL;
+    }
+
+    void *Memory = mmap(NULL, (size_t)Stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, Shm, 0);
+
+    if (Memory == MAP_FAILED)
+    {
+        close(Shm);
+        return NULL;
+    }
+
+    *Size = (size_t)Stat.st_size;
+    *Own = Shm;
+
+    return Memory;
+#endif
+}
+
+void FLEX_Shared_Delete(void *Memory, size_t Size, int Fd, const char *Name)
+{
+#ifndef _WIN32
+    munmap(Memory, Size);
+    close(Fd);
+
+    if (Name)
+        shm_unlink(Name);
+#endif
+}
+
+void FLEX_File_Unmap(void *Memory, size_t Size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(Memory);
+#else
+    munmap(Memory, Size);
+#endif
+}
+
+int FLEX_File_Sync(void *Memory, size_t Size)
+{
+    /* Both calls need a page aligned start */
+    size_t PageSize = FLEX_Page_Size();
+    size_t Offset = (size_t)(uintptr_t)Memory % PageSize;
+
+    Memory = (uint8_t *)Memory - Offset;
+    Size += Offset;
+
+#ifdef _WIN32
+    /* Pages are written, the disk cache is not flushed without a file handle */
+    return FlushViewOfFile(Memory, Size) ? 0 : (int)GetLastError();
+#else
+    return msync(Memory, Size, MS_SYNC) ? errno : 0;
+#endif
+}
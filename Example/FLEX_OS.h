@@ -3,20 +3,87 @@
 
 #include "FLEX.h"
 
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
 #ifdef _WIN32
 typedef HANDLE FLEX_MUTEX;
 typedef HANDLE FLEX_EVENT; /* Use event instead of CV on Windows */
 #else
 typedef pthread_mutex_t FLEX_MUTEX;
-typedef pthread_cond_t  FLEX_EVENT; /* Use CV on Others */
+
+typedef struct FLEX_EVENT           /* Use CV on Others */
+{
+    pthread_cond_t  Cond;
+    int             Fd;             /* eventfd backend, valid if HasFd */
+    bool            HasFd;
+
+} FLEX_EVENT;
 #endif
 
+/* io_uring instance, see FLEX_Uring_Create. Fields are private to FLEX_OS. */
+typedef struct FLEX_URING
+{
+    int             Fd;             /* -1 if not created */
+    bool            Fixed;          /* A table of fixed buffers is registered */
+
+    void *          SqRing;
+    size_t          SqRingSize;
+    void *          CqRing;         /* Same as SqRing if mapped once */
+    size_t          CqRingSize;
+    void *          Sqes;
+    size_t          SqesSize;
+
+    volatile uint32_t * SqHead;
+    volatile uint32_t * SqTail;
+    uint32_t *      SqArray;
+    uint32_t        SqMask;
+    uint32_t        SqEntries;
+    uint32_t        SqLocal;        /* Tail of prepared entries, published on submit */
+
+    volatile uint32_t * CqHead;
+    volatile uint32_t * CqTail;
+    void *          Cqes;
+    uint32_t        CqMask;
+
+    void *          Iovecs;         /* Vectors of the submission entries */
+
+} FLEX_URING;
+
+/* Operations of FLEX_Uring_Prepare */
+#define FLEX_URING_READ     0
+#define FLEX_URING_WRITE    1
+
+/* Maximum buffers of one operation, both parts of a wrapped range */
+#define FLEX_URING_PARTS    2
+
+/* Page options, see FLEX_Pages_Apply */
+#define FLEX_PAGES_HUGE     0x00000001UL    /* Transparent huge pages */
+#define FLEX_PAGES_NODE     0x00000002UL    /* Bind to a NUMA node */
+#define FLEX_PAGES_LOCK     0x00000004UL    /* Lock in physical memory */
+#define FLEX_PAGES_PREFAULT 0x00000008UL    /* Fault in all pages */
+
+/* Processor features, see FLEX_Cpu_Features */
+#define FLEX_CPU_SSE2   0x00000001UL
+#define FLEX_CPU_SSE42  0x00000002UL
+#define FLEX_CPU_AVX2   0x00000004UL
+
 #ifdef _WIN32
 #define FLEX_INFINITE INFINITE
 #else
 #define FLEX_INFINITE 0xFFFFFFFFUL
 #endif
 
+/* Cache line size of x86 and x64 */
+#define FLEX_CACHE_LINE 64
+
+#ifdef _WIN32
+#define FLEX_ALIGNED(N) __declspec(align(N))
+#else
+#define FLEX_ALIGNED(N) __attribute__((aligned(N)))
+#endif
+
 /////////////////////////////////////////////////////////////////////////////
 //                                                                         //
 // This file defines some OS dependent functions to support cross-platform //
@@ -56,6 +123,27 @@ int FLEX_DeleteMutex(FLEX_MUTEX *Mutex);
  */
 int FLEX_CreateEvent(FLEX_EVENT *Event);
 
+/**
+ * Create an eventfd backend for an Event, so that it can be watched with
+ * poll, select or epoll next to sockets
+ *
+ * @param Event Pointer to FLEX_EVENT created by FLEX_CreateEvent
+ *
+ * @return 0 if successful, an error code on failure
+ *
+ * @remark Not supported on Windows
+ */
+int FLEX_CreateEventFd(FLEX_EVENT *Event);
+
+/**
+ * Get the file descriptor of an Event
+ *
+ * @param Event Pointer to FLEX_EVENT
+ *
+ * @return File descriptor, or -1 if no eventfd backend is created
+ */
+int FLEX_Event_GetFd(FLEX_EVENT *Event);
+
 /**
  * Delete Event primitives and release resources
  *
@@ -95,7 +183,7 @@ int FLEX_Mutex_Unlock(FLEX_MUTEX *Mutex);
  * @param Event        Pointer to FLEX_EVENT
  * @param Mutex        Pointer to FLEX_MUTEX
  * @param Milliseconds Timeout in milliseconds, or FLEX_INFINITE to wait until signaled
- * @param Tp           Absolute time to wait, or NULL to wait until signaled
+ * @param Tp           Absolute CLOCK_MONOTONIC time to wait, or NULL to wait until signaled
  *
  * @return 0 if successful, an error code on failure
  */
@@ -114,6 +202,247 @@ int FLEX_Event_Wait(FLEX_EVENT *Event, FLEX_MUTEX *Mutex, struct timespec *Tp);
  */
 int FLEX_Event_Signal(FLEX_EVENT *Event);
 
+/**
+ * Raise the file descriptor of an Event, see FLEX_CreateEventFd
+ *
+ * @param Event Pointer to FLEX_EVENT
+ *
+ * @return 0 if successful, an error code on failure
+ */
+int FLEX_Event_Notify(FLEX_EVENT *Event);
+
+/**
+ * Get monotonic clock time, which is not affected by wall clock changes
+ *
+ * @return Time in nanoseconds
+ */
+uint64_t FLEX_Clock_Now(void);
+
+/**
+ * Yield the processor to other threads
+ *
+ * @return None
+ */
+void FLEX_Thread_Yield(void);
+
+#ifndef _WIN32
+/**
+ * Wait on a futex word until woken up or the deadline expires
+ *
+ * @param Ptr      Pointer to the word, only the low 32 bits are compared
+ * @param Value    Expected value, return immediately if the word differs
+ * @param Deadline Absolute FLEX_Clock_Now time, or FLEX_DEADLINE_INFINITE
+ * @param Shared   The word is in memory shared with other processes
+ *
+ * @return 0 if woken up (or spuriously), ETIMEDOUT on timeout
+ */
+int FLEX_Futex_Wait(volatile size_t *Ptr, size_t Value, uint64_t Deadline, bool Shared);
+
+/**
+ * Wake up all threads waiting on a futex word
+ *
+ * @param Ptr    Pointer to the word
+ * @param Shared The word is in memory shared with other processes
+ *
+ * @return 0 if successful, an error code on failure
+ */
+int FLEX_Futex_Wake(volatile size_t *Ptr, bool Shared);
+#endif
+
+/**
+ * Get features of the processor, also checking OS support for AVX state
+ *
+ * @return Combination of FLEX_CPU_XXX, 0 if not x86/x64
+ */
+uint32_t FLEX_Cpu_Features(void);
+
+/**
+ * Update a CRC32C (Castagnoli) checksum, with the SSE4.2 crc32 instruction
+ * when available and slice-by-8 tables otherwise
+ *
+ * @param Crc  Checksum of the data before, 0 to start
+ * @param Data Data to add
+ * @param Size Data size in bytes
+ *
+ * @return Checksum of the data before followed by Data
+ */
+uint32_t FLEX_Crc32c(uint32_t Crc, const uint8_t *Data, size_t Size);
+
+/**
+ * Copy memory with non-temporal stores, with SSE2/AVX2 kernels on x86/x64
+ *
+ * @param Dst  Destination
+ * @param Src  Source, not overlapping Dst
+ * @param Size Size in bytes
+ *
+ * @return void
+ *
+ * @note The destination bypasses the cache, so it pays off for copies larger than
+ *       the cache. The stores are fenced before return. Falls back to memcpy.
+ */
+void FLEX_Copy_Stream(void *Dst, const void *Src, size_t Size);
+
+/**
+ * Find the first occurrence of a pattern, with SSE2/AVX2 kernels on x86/x64
+ *
+ * @param Data    Data to search
+ * @param Size    Data size in bytes
+ * @param Pattern Pattern to find
+ * @param Length  Pattern length in bytes (> 0)
+ *
+ * @return Offset of the first match lying entirely in Data, or Size if none
+ */
+size_t FLEX_Find_Pattern(const uint8_t *Data, size_t Size, const uint8_t *Pattern, size_t Length);
+
+/**
+ * Read from or write to a file descriptor with up to two buffers in one call
+ *
+ * @param Fd    File descriptor, blocking or non-blocking
+ * @param Data  Buffers to read into or write from
+ * @param Size  Buffer sizes in bytes
+ * @param Count Number of buffers, 1 or 2
+ *
+ * @return Bytes transferred, or -1 with errno set. Interrupted calls are restarted.
+ *         Always -1 (ENOSYS) on Windows.
+ */
+int64_t FLEX_Fd_Read(int Fd, uint8_t **Data, size_t *Size, int Count);
+int64_t FLEX_Fd_Write(int Fd, uint8_t **Data, size_t *Size, int Count);
+
+/**
+ * Splice user pages into a pipe, or send them with MSG_ZEROCOPY, without a copy
+ *
+ * @param Fd    Pipe write end, or socket with SO_ZEROCOPY set
+ * @param Data  Buffers to transfer, which must not change until the transfer completes
+ * @param Size  Buffer sizes in bytes
+ * @param Count Number of buffers, 1 or 2
+ *
+ * @return Bytes transferred, or -1 with errno set. Interrupted calls are restarted.
+ *         Always -1 (ENOSYS) on Windows.
+ */
+int64_t FLEX_Fd_Splice(int Fd, uint8_t **Data, size_t *Size, int Count);
+int64_t FLEX_Fd_SendZeroCopy(int Fd, uint8_t **Data, size_t *Size, int Count);
+
+/**
+ * Get the next zero-copy completion of a socket, without waiting
+ *
+ * @param Fd Socket
+ * @param Lo First completed send
+ * @param Hi Last completed send
+ *
+ * @return 1 if a completion is got, 0 if none, or -1 with errno set
+ */
+int FLEX_Fd_ZeroCopyDone(int Fd, uint32_t *Lo, uint32_t *Hi);
+
+/**
+ * Wait until descriptors are ready to read or write
+ *
+ * @param Fd           File descriptors
+ * @param Write        Wait for each descriptor to be writable, otherwise readable
+ * @param Count        Number of descriptors
+ * @param Milliseconds Wait timeout, or FLEX_INFINITE to wait infinitely
+ *
+ * @return Number of ready descriptors, 0 on timeout, or -1 with errno set.
+ *         Always -1 (ENOSYS) on Windows.
+ */
+int FLEX_Fd_Poll(const int *Fd, const bool *Write, int Count, uint32_t Milliseconds);
+
+/**
+ * Create an io_uring instance
+ *
+ * @param Uring   Pointer to FLEX_URING
+ * @param Entries Submission queue entries, rounded up to a power of 2 by the kernel
+ * @param Fixed   Number of fixed buffer slots to register, 0 for none
+ *
+ * @return 0 if successful, an error code on failure. ENOSYS if io_uring is not
+ *         supported, always on Windows.
+ *
+ * @note Failing to register fixed buffer slots is not an error, Uring->Fixed is
+ *       false in that case
+ */
+int FLEX_Uring_Create(FLEX_URING *Uring, uint32_t Entries, uint32_t Fixed);
+
+/**
+ * Delete an io_uring instance created by FLEX_Uring_Create
+ *
+ * @param Uring Pointer to FLEX_URING
+ *
+ * @return None
+ */
+void FLEX_Uring_Delete(FLEX_URING *Uring);
+
+/**
+ * Register memory in a fixed buffer slot, or clear the slot
+ *
+ * @param Uring Pointer to FLEX_URING with fixed buffers
+ * @param Index Slot index
+ * @param Data  Memory to register, NULL to clear the slot
+ * @param Size  Memory size in bytes
+ *
+ * @return 0 if successful, an error code on failure
+ */
+int FLEX_Uring_Register(FLEX_URING *Uring, uint32_t Index, void *Data, size_t Size);
+
+/**
+ * Prepare a read or write at the current position of a descriptor
+ *
+ * @param Uring    Pointer to FLEX_URING
+ * @param Op       FLEX_URING_READ or FLEX_URING_WRITE
+ * @param Fd       File descriptor
+ * @param Data     Buffers, within the fixed buffer slot if Fixed >= 0
+ * @param Size     Buffer sizes in bytes
+ * @param Count    Number of buffers (1 to FLEX_URING_PARTS)
+ * @param Fixed    Fixed buffer slot, -1 if not registered. Used for one buffer only.
+ * @param UserData Value passed back by FLEX_Uring_Reap
+ *
+ * @return true if prepared, false if the submission queue is full
+ *
+ * @note Several buffers are read or written in order by one vectored operation
+ */
+bool FLEX_Uring_Prepare(FLEX_URING *Uring, int Op, int Fd, uint8_t **Data, size_t *Size, int Count, int Fixed, uint64_t UserData);
+
+/**
+ * Prepare cancellation of a prepared or submitted operation
+ *
+ * @param Uring    Pointer to FLEX_URING
+ * @param Target   UserData of the operation to cancel
+ * @param UserData Value passed back by FLEX_Uring_Reap for the cancellation itself
+ *
+ * @return true if prepared, false if the submission queue is full
+ */
+bool FLEX_Uring_Cancel(FLEX_URING *Uring, uint64_t Target, uint64_t UserData);
+
+/**
+ * Submit prepared operations, and wait for completions
+ *
+ * @param Uring        Pointer to FLEX_URING
+ * @param Wait         Number of completions to wait for, 0 not to wait
+ * @param Milliseconds Wait timeout, or FLEX_INFINITE to wait infinitely
+ *
+ * @return 0 if successful or timed out, an error code on failure
+ */
+int FLEX_Uring_Submit(FLEX_URING *Uring, uint32_t Wait, uint32_t Milliseconds);
+
+/**
+ * Take the next completion, without waiting
+ *
+ * @param Uring    Pointer to FLEX_URING
+ * @param UserData UserData of the completed operation
+ * @param Result   Bytes transferred, or a negative error code
+ *
+ * @return true if a completion is taken, false if none
+ */
+bool FLEX_Uring_Reap(FLEX_URING *Uring, uint64_t *UserData, int32_t *Result);
+
+/**
+ * Get the number of unread bytes in a pipe or socket
+ *
+ * @param Fd    File descriptor
+ * @param Count Unread bytes
+ *
+ * @return 0 if successful, or -1 with errno set
+ */
+int FLEX_Fd_Unread(int Fd, size_t *Count);
+
 /**
  * Malloc address aligned memory
  *
@@ -133,4 +462,341 @@ void *FLEX_Aligned_Malloc(size_t Size, size_t Alignment);
  */
 void FLEX_Aligned_Free(void *Memory);
 
+/**
+ * Get page size (allocation granularity on Windows) for mirrored memory
+ *
+ * @return Page size in bytes
+ */
+size_t FLEX_Page_Size(void);
+
+/**
+ * Malloc mirrored memory. The same physical pages are mapped twice, back
+ * to back, so that Memory[i] and Memory[i + Size] are the same byte.
+ *
+ * @param Size Size bytes to allocate (> 0, multiple of FLEX_Page_Size)
+ *
+ * @return Memory pointer on success, NULL on failure
+ */
+void *FLEX_Mirror_Malloc(size_t Size);
+
+/**
+ * Free memory allocated by FLEX_Mirror_Malloc
+ *
+ * @param Memory Pointer to memory
+ * @param Size   Size passed to FLEX_Mirror_Malloc
+ *
+ * @return void
+ */
+void FLEX_Mirror_Free(void *Memory, size_t Size);
+
+/**
+ * Get the size of huge pages of the hugetlbfs pool
+ *
+ * @return Huge page size in bytes, or 0 if not supported
+ */
+size_t FLEX_Huge_Page_Size(void);
+
+/**
+ * Malloc anonymous page-aligned memory
+ *
+ * @param Size      Size bytes to allocate (> 0, multiple of FLEX_Page_Size, or of
+ *                  FLEX_Huge_Page_Size with HugeTlb)
+ * @param HugeTlb   true to take the pages from the hugetlbfs pool
+ * @param NoReserve true to reserve no swap space, pages are committed as touched
+ *
+ * @return Memory pointer on success, NULL on failure
+ */
+void *FLEX_Pages_Malloc(size_t Size, bool HugeTlb, bool NoReserve);
+
+/**
+ * Free memory allocated by FLEX_Pages_Malloc
+ *
+ * @param Memory Pointer to memory
+ * @param Size   Size passed to FLEX_Pages_Malloc
+ *
+ * @return void
+ */
+void FLEX_Pages_Free(void *Memory, size_t Size);
+
+/**
+ * Apply page options to mapped memory
+ *
+ * @param Memory  Page-aligned memory pointer
+ * @param Size    Size in bytes, multiple of FLEX_Page_Size
+ * @param Options Combination of FLEX_PAGES_XXX
+ * @param Node    NUMA node for FLEX_PAGES_NODE
+ *
+ * @return Options that took effect
+ *
+ * @note Options are applied in the order huge pages, node, lock and prefault, so
+ *       that pages are faulted in where and as they should be. Prefault writes
+ *       each page with the byte it holds. Only lock and prefault take effect on
+ *       Windows.
+ */
+uint32_t FLEX_Pages_Apply(void *Memory, size_t Size, uint32_t Options, int Node);
+
+/**
+ * Give the pages within a memory range back to the system
+ *
+ * @param Memory Memory pointer, from FLEX_Pages_Malloc without HugeTlb
+ * @param Size   Size in bytes
+ *
+ * @return Bytes released, only whole pages inside the range are
+ *
+ * @note Released pages read as zeros (undefined on Windows) when touched again
+ */
+size_t FLEX_Pages_Release(void *Memory, size_t Size);
+
+/**
+ * Count resident bytes of a memory range
+ *
+ * @param Memory Memory pointer
+ * @param Size   Size in bytes
+ *
+ * @return Bytes of resident pages that overlap the range, or Size if unknown
+ */
+size_t FLEX_Pages_Resident(void *Memory, size_t Size);
+
+/**
+ * Map a file shared, creating it or extending it to Size bytes if shorter
+ *
+ * @param Path    File path
+ * @param Size    Mapping size in bytes (> 0)
+ * @param Created Set to true if the file was created or extended
+ *
+ * @return Memory pointer on success, NULL on failure
+ *
+ * @note Stores to the memory reach the file even if the process crashes
+ */
+void *FLEX_File_Map(const char *Path, size_t Size, bool *Created);
+
+/**
+ * Unmap memory mapped by FLEX_File_Map
+ *
+ * @param Memory Memory pointer returned by FLEX_File_Map
+ * @param Size   Size passed to FLEX_File_Map
+ *
+ * @return None
+ */
+void FLEX_File_Unmap(void *Memory, size_t Size);
+
+/**
+ * Create shared memory, named or anonymous, and map it
+ *
+ * @param Name Name of the shared memory object ("/name"), NULL for an anonymous one
+ * @param Size Size in bytes (> 0)
+ * @param Fd   Descriptor of the shared memory, to pass to other processes
+ *
+ * @return Memory pointer on success, NULL on failure. Always NULL on Windows.
+ *
+ * @note Creating a name that exists fails. The memory reads as zeros.
+ */
+void *FLEX_Shared_Create(const char *Name, size_t Size, int *Fd);
+
+/**
+ * Map shared memory created by another process, by name or descriptor
+ *
+ * @param Name Name passed to FLEX_Shared_Create, or NULL to use Fd
+ * @param Fd   Descriptor got from the other process, duplicated for the caller
+ * @param Size Size of the shared memory
+ * @param Own  Descriptor of the caller
+ *
+ * @return Memory pointer on success, NULL on failure. Always NULL on Windows.
+ */
+void *FLEX_Shared_Attach(const char *Name, int Fd, size_t *Size, int *Own);
+
+/**
+ * Unmap shared memory and close its descriptor
+ *
+ * @param Memory Memory pointer
+ * @param Size   Size of the memory
+ * @param Fd     Descriptor
+ * @param Name   Name to remove, NULL to keep it
+ *
+ * @return None
+ */
+void FLEX_Shared_Delete(void *Memory, size_t Size, int Fd, const char *Name);
+
+/**
+ * Write part of a file mapping to the storage, and wait until it is done
+ *
+ * @param Memory Start of the part, within memory mapped by FLEX_File_Map
+ * @param Size   Size of the part in bytes
+ *
+ * @return 0 if successful, an error code on failure
+ */
+int FLEX_File_Sync(void *Memory, size_t Size);
+
+/////////////////////////////////////////////////////////////////////////////
+//                                                                         //
+// Atomic operations used by the lock-free paths. They are defined inline  //
+// here because they sit on the hot path of every Get and Put call.        //
+//                                                                         //
+/////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Load a value with acquire semantics
+ *
+ * @param Ptr Pointer to the value
+ *
+ * @return The loaded value
+ */
+static inline size_t FLEX_Atomic_Load(volatile size_t *Ptr)
+{
+#ifdef _WIN32
+    size_t Value = *Ptr; /* Loads are not reordered with older loads on x86/x64 */
+    _ReadWriteBarrier();
+    return Value;
+#else
+    return __atomic_load_n(Ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Store a value with release semantics
+ *
+ * @param Ptr   Pointer to the value
+ * @param Value Value to store
+ *
+ * @return None
+ */
+static inline void FLEX_Atomic_Store(volatile size_t *Ptr, size_t Value)
+{
+#ifdef _WIN32
+    _ReadWriteBarrier(); /* Stores are not reordered with older stores on x86/x64 */
+    *Ptr = Value;
+#else
+    __atomic_store_n(Ptr, Value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * Compare and exchange a value, full barrier
+ *
+ * @param Ptr      Pointer to the value
+ * @param Expected Value expected at Ptr
+ * @param Desired  Value to store if Ptr holds Expected
+ *
+ * @return true if exchanged, otherwise false
+ */
+static inline bool FLEX_Atomic_CompareExchange(volatile size_t *Ptr, size_t Expected, size_t Desired)
+{
+#ifdef _WIN64
+    return InterlockedCompareExchange64((volatile LONG64 *)Ptr, (LONG64)Desired, (LONG64)Expected) == (LONG64)Expected;
+#elif defined(_WIN32)
+    return InterlockedCompareExchange((volatile LONG *)Ptr, (LONG)Desired, (LONG)Expected) == (LONG)Expected;
+#else
+    return __atomic_compare_exchange_n(Ptr, &Expected, Desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Add to a value, full barrier
+ *
+ * @param Ptr   Pointer to the value
+ * @param Value Value to add
+ *
+ * @return The value before the addition
+ */
+static inline size_t FLEX_Atomic_Add(volatile size_t *Ptr, size_t Value)
+{
+#ifdef _WIN64
+    return (size_t)InterlockedExchangeAdd64((volatile LONG64 *)Ptr, (LONG64)Value);
+#elif defined(_WIN32)
+    return (size_t)InterlockedExchangeAdd((volatile LONG *)Ptr, (LONG)Value);
+#else
+    return __atomic_fetch_add(Ptr, Value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Load a 64-bit value with acquire semantics, also atomic on x86
+ *
+ * @param Ptr Pointer to the value
+ *
+ * @return The loaded value
+ */
+static inline uint64_t FLEX_Atomic_Load64(volatile uint64_t *Ptr)
+{
+#ifdef _WIN32
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)Ptr, 0, 0);
+#else
+    return __atomic_load_n(Ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+ * Store a 64-bit value with release semantics, also atomic on x86
+ *
+ * @param Ptr   Pointer to the value
+ * @param Value Value to store
+ *
+ * @return None
+ */
+static inline void FLEX_Atomic_Store64(volatile uint64_t *Ptr, uint64_t Value)
+{
+#ifdef _WIN32
+    uint64_t Expected = *Ptr;
+
+    /* A plain 64-bit store may be split on x86 */
+    for (;;)
+    {
+        uint64_t Current = (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)Ptr, (LONG64)Value, (LONG64)Expected);
+
+        if (Current == Expected)
+            break;
+
+        Expected = Current;
+    }
+#else
+    __atomic_store_n(Ptr, Value, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * Compare and exchange a 64-bit value, full barrier, also atomic on x86
+ *
+ * @param Ptr      Pointer to the value
+ * @param Expected Value expected at Ptr
+ * @param Desired  Value to store if Ptr holds Expected
+ *
+ * @return true if exchanged, otherwise false
+ */
+static inline bool FLEX_Atomic_CompareExchange64(volatile uint64_t *Ptr, uint64_t Expected, uint64_t Desired)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange64((volatile LONG64 *)Ptr, (LONG64)Desired, (LONG64)Expected) == (LONG64)Expected;
+#else
+    return __atomic_compare_exchange_n(Ptr, &Expected, Desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Full memory barrier, orders a preceding store against a following load
+ *
+ * @return None
+ */
+static inline void FLEX_Atomic_Fence(void)
+{
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Hint the processor that the caller is in a spin-wait loop
+ *
+ * @return None
+ */
+static inline void FLEX_Cpu_Pause(void)
+{
+#ifdef _WIN32
+    YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
 #endif // __FLEX_OS_H__
\ No newline at end of file